@@ -0,0 +1,70 @@
+#pragma once
+#include <xmmintrin.h>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace base
+{
+// fixed capacity array whose storage starts on an ALIGNMENT byte boundary
+// used for SoA streams that are walked with SIMD loads
+template<typename T, size_t ALIGNMENT=64>
+class Aligned_array
+{
+public:
+    Aligned_array() {}
+
+    explicit Aligned_array(size_t capacity)
+    {
+        allocate(capacity);
+    }
+
+    ~Aligned_array()
+    {
+        if (p_data_) _mm_free(p_data_);
+    }
+
+    Aligned_array(const Aligned_array &)=delete;
+    Aligned_array &operator=(const Aligned_array &)=delete;
+
+    void allocate(size_t capacity)
+    {
+        if (p_data_) _mm_free(p_data_);
+        // round up so that full SIMD blocks never read past the allocation
+        size_t bytes=((capacity * sizeof(T) - 1) / ALIGNMENT + 1) * ALIGNMENT;
+        p_data_=reinterpret_cast<T *>(_mm_malloc(bytes, ALIGNMENT));
+        if (!p_data_) throw std::runtime_error("aligned allocation failed");
+        memset(p_data_, 0, bytes);
+        capacity_=capacity;
+    }
+
+    T *data()
+    {
+        return p_data_;
+    }
+
+    const T *data() const
+    {
+        return p_data_;
+    }
+
+    T &operator[](size_t i)
+    {
+        return p_data_[i];
+    }
+
+    const T &operator[](size_t i) const
+    {
+        return p_data_[i];
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    T *p_data_{nullptr};
+    size_t capacity_{0};
+};
+} // namespace base
@@ -235,7 +235,7 @@ static void update_device_local_buffer_memory(
                             0, nullptr);
 
     // copy data from staging buf to buf
-    vk::BufferCopy region(0, offset, p_buffer->size);
+    vk::BufferCopy region(0, offset, data_size);
     cmd_buf.copyBuffer(p_staging_buf->buf, p_buffer->buf, 1, &region);
 
     // change buf layout to final
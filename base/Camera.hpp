@@ -6,6 +6,17 @@
 
 namespace base
 {
+enum Frustum_plane
+{
+    FRUSTUM_LEFT=0,
+    FRUSTUM_RIGHT=1,
+    FRUSTUM_BOTTOM=2,
+    FRUSTUM_TOP=3,
+    FRUSTUM_NEAR=4,
+    FRUSTUM_FAR=5,
+    FRUSTUM_PLANE_COUNT=6
+};
+
 class Camera
 {
 public:
@@ -77,6 +88,30 @@ public:
         update();
     }
 
+    // world space planes (normal, d) of projection * view, normalized so that
+    // dot(normal, p) + d is the signed distance, positive inside
+    void get_frustum_planes(glm::vec4 planes[FRUSTUM_PLANE_COUNT]) const
+    {
+        const glm::mat4 m=projection * view;
+        const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        planes[FRUSTUM_LEFT]=row3 + row0;
+        planes[FRUSTUM_RIGHT]=row3 - row0;
+        planes[FRUSTUM_BOTTOM]=row3 + row1;
+        planes[FRUSTUM_TOP]=row3 - row1;
+#ifdef GLM_FORCE_DEPTH_ZERO_TO_ONE
+        planes[FRUSTUM_NEAR]=row2;
+#else
+        planes[FRUSTUM_NEAR]=row3 + row2;
+#endif
+        planes[FRUSTUM_FAR]=row3 - row2;
+        for (int i=0; i < FRUSTUM_PLANE_COUNT; i++) {
+            planes[i]/=glm::length(glm::vec3(planes[i]));
+        }
+    }
+
     void print_stat()
     {
         std::cout << "camera position " <<
@@ -27,12 +27,15 @@ public:
                 code_size, code_ptr));
     }
 
-    vk::PipelineShaderStageCreateInfo create_pipeline_stage_info()
+    // p_specialization_info has to outlive the pipeline creation, constant
+    // ids the shader does not declare are ignored
+    vk::PipelineShaderStageCreateInfo create_pipeline_stage_info(const vk::SpecializationInfo *p_specialization_info=nullptr)
     {
         return {{},
             shader_stage_flag_bits_,
             module_,
-            "main"};
+            "main",
+            p_specialization_info};
     }
 
 private:
@@ -263,6 +263,13 @@ private:
 		on_key(key);
 	    }
 	    break;
+	    case WM_SYSKEYDOWN:
+	    {
+		// F10 comes as a system key, alt combinations stay with windows
+		if (wparam != VK_F10) return DefWindowProc(hwnd, msg, wparam, lparam);
+		on_key(KEY_F10);
+	    }
+	    break;
 	    case WM_CLOSE:on_key(KEY_SHUTDOWN);
 		break;
 	    case WM_DESTROY:post_quit_msg();
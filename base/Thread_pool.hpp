@@ -0,0 +1,123 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace base
+{
+// fixed set of worker threads for blocking data parallel loops
+// the calling thread takes part in the work, so a pool of 0 workers runs inline
+class Thread_pool
+{
+public:
+    typedef std::function<void(uint32_t begin, uint32_t end)> Range_fn;
+
+    explicit Thread_pool(uint32_t worker_count=default_worker_count())
+    {
+        for (uint32_t i=0; i < worker_count; i++) {
+            workers_.emplace_back([this] { worker_loop_(); });
+        }
+    }
+
+    ~Thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_=true;
+        }
+        work_cv_.notify_all();
+        for (auto &t : workers_) t.join();
+    }
+
+    Thread_pool(const Thread_pool &)=delete;
+    Thread_pool &operator=(const Thread_pool &)=delete;
+
+    static uint32_t default_worker_count()
+    {
+        uint32_t hw=std::thread::hardware_concurrency();
+        return hw > 1 ? hw - 1 : 0;
+    }
+
+    uint32_t thread_count() const
+    {
+        return static_cast<uint32_t>(workers_.size()) + 1;
+    }
+
+    // calls fn on disjoint [begin, end) chunks of at most grain elements
+    // covering [0, count) and returns once all chunks are done
+    void parallel_for(uint32_t count, uint32_t grain, const Range_fn &fn)
+    {
+        if (count == 0) return;
+        grain=std::max(grain, 1u);
+        if (workers_.empty() || count <= grain) {
+            fn(0, count);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            p_fn_=&fn;
+            count_=count;
+            grain_=grain;
+            next_=0;
+            pending_=(count - 1) / grain + 1;
+            generation_++;
+        }
+        work_cv_.notify_all();
+
+        run_chunks_();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this] { return pending_ == 0; });
+        p_fn_=nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    bool quit_{false};
+    uint64_t generation_{0};
+
+    // current job, guarded by mutex_
+    const Range_fn *p_fn_{nullptr};
+    uint32_t count_{0};
+    uint32_t grain_{1};
+    uint32_t next_{0};
+    uint32_t pending_{0};
+
+    void run_chunks_()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (p_fn_ && next_ < count_) {
+            const Range_fn &fn=*p_fn_;
+            uint32_t begin=next_;
+            uint32_t end=std::min(count_, begin + grain_);
+            next_=end;
+            lock.unlock();
+            fn(begin, end);
+            lock.lock();
+            if (--pending_ == 0) done_cv_.notify_all();
+        }
+    }
+
+    void worker_loop_()
+    {
+        uint64_t seen=0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_cv_.wait(lock, [&] { return quit_ || generation_ != seen; });
+                if (quit_) return;
+                seen=generation_;
+            }
+            run_chunks_();
+        }
+    }
+};
+} // namespace base
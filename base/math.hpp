@@ -1,5 +1,7 @@
 #pragma once
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <glm/glm.hpp>
 #define PI 3.1415926
 #define EPS 0.0001
@@ -11,6 +13,52 @@ float clamp(float num, float min, float max)
     return std::min(max, std::max(min, num));
 }
 
+// ieee half float, round to nearest even
+uint16_t float_to_half(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint32_t sign=(x >> 16) & 0x8000;
+    x&=0x7fffffff;
+    if (x >= 0x47800000) return static_cast<uint16_t>(sign | (x > 0x7f800000 ? 0x7e00 : 0x7c00)); // overflow, inf, nan
+    if (x < 0x38800000) {
+        // subnormal half
+        if (x < 0x33000000) return static_cast<uint16_t>(sign);
+        const uint32_t shift=126 - (x >> 23);
+        const uint32_t m=(x & 0x7fffff) | 0x800000;
+        uint32_t h=m >> shift;
+        const uint32_t rem=m & ((1u << shift) - 1);
+        const uint32_t half=1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1))) h++;
+        return static_cast<uint16_t>(sign | h);
+    }
+    x+=0xc8000fff + ((x >> 13) & 1); // rebias exponent, round
+    return static_cast<uint16_t>(sign | (x >> 13));
+}
+
+float half_to_float(uint16_t h)
+{
+    const uint32_t sign=static_cast<uint32_t>(h & 0x8000) << 16;
+    const uint32_t e=(h >> 10) & 0x1f;
+    uint32_t m=h & 0x3ff;
+    uint32_t x;
+    if (e == 0x1f) x=sign | 0x7f800000 | (m << 13);
+    else if (e != 0) x=sign | ((e + 112) << 23) | (m << 13);
+    else if (m == 0) x=sign;
+    else {
+        // subnormal, normalize
+        uint32_t exp=113;
+        while (!(m & 0x400)) {
+            m<<=1;
+            exp--;
+        }
+        x=sign | (exp << 23) | ((m & 0x3ff) << 13);
+    }
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
 class Spherical
 {
 public:
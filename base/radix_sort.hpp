@@ -0,0 +1,74 @@
+#pragma once
+#include "Thread_pool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace base
+{
+// stable lsd radix sort of (key, value) pairs, 8 bits per pass.
+// the input is split into a fixed number of chunks that are counted and
+// scattered in parallel; chunk boundaries don't depend on the thread count
+// so the result is the same for any pool. the sorted pairs end up in keys
+// and values, tmp_keys and tmp_values must hold count elements
+void parallel_radix_sort(Thread_pool &pool,
+                         uint32_t *keys,
+                         uint32_t *values,
+                         uint32_t *tmp_keys,
+                         uint32_t *tmp_values,
+                         uint32_t count,
+                         uint32_t key_bits=32)
+{
+    const uint32_t RADIX=256;
+    const uint32_t MIN_CHUNK_SIZE=16384;
+    const uint32_t MAX_CHUNK_COUNT=64;
+    const uint32_t chunk_count=std::max(1u, std::min(MAX_CHUNK_COUNT, count / MIN_CHUNK_SIZE));
+    const uint32_t chunk_size=(count + chunk_count - 1) / chunk_count;
+    std::vector<uint32_t> offsets(chunk_count * RADIX);
+
+    uint32_t *p_src_keys=keys, *p_src_values=values;
+    uint32_t *p_dst_keys=tmp_keys, *p_dst_values=tmp_values;
+    for (uint32_t shift=0; shift < key_bits; shift+=8) {
+        // per chunk digit histograms
+        pool.parallel_for(chunk_count, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t c=begin; c < end; c++) {
+                uint32_t *p_hist=offsets.data() + c * RADIX;
+                std::fill(p_hist, p_hist + RADIX, 0);
+                const uint32_t chunk_end=std::min(count, (c + 1) * chunk_size);
+                for (uint32_t i=c * chunk_size; i < chunk_end; i++) p_hist[(p_src_keys[i] >> shift) & 0xff]++;
+            }
+        });
+
+        // exclusive scan in digit-major, chunk-minor order keeps it stable
+        uint32_t sum=0;
+        for (uint32_t d=0; d < RADIX; d++) {
+            for (uint32_t c=0; c < chunk_count; c++) {
+                uint32_t n=offsets[c * RADIX + d];
+                offsets[c * RADIX + d]=sum;
+                sum+=n;
+            }
+        }
+
+        pool.parallel_for(chunk_count, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t c=begin; c < end; c++) {
+                uint32_t *p_offset=offsets.data() + c * RADIX;
+                const uint32_t chunk_end=std::min(count, (c + 1) * chunk_size);
+                for (uint32_t i=c * chunk_size; i < chunk_end; i++) {
+                    uint32_t dst=p_offset[(p_src_keys[i] >> shift) & 0xff]++;
+                    p_dst_keys[dst]=p_src_keys[i];
+                    p_dst_values[dst]=p_src_values[i];
+                }
+            }
+        });
+
+        std::swap(p_src_keys, p_dst_keys);
+        std::swap(p_src_values, p_dst_values);
+    }
+
+    // odd pass count leaves the result in the tmp arrays
+    if (p_src_keys != keys) {
+        std::copy(p_src_keys, p_src_keys + count, keys);
+        std::copy(p_src_values, p_src_values + count, values);
+    }
+}
+} // namespace base
@@ -1,15 +1,45 @@
 #pragma once
+#include <cstdint>
 
 namespace base
 {
-
-float random_unit_float()
+// splitmix64 finalizer, a bijective 64 bit mix
+inline uint64_t splitmix64(uint64_t x)
 {
-    return std::rand() / static_cast<float>(RAND_MAX);
+    x+=0x9e3779b97f4a7c15ull;
+    x=(x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x=(x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
 }
 
-float random_range(float low, float high)
+// counter-based generator: the n-th value of a stream only depends on
+// (seed, stream, n), so any element can be generated independently and
+// results do not depend on evaluation order or thread count
+class Random
 {
-    return low + (high - low)*random_unit_float();
-}
-} // namespace base
\ No newline at end of file
+public:
+    Random(uint64_t seed, uint64_t stream)
+        :key_(splitmix64(seed ^ splitmix64(stream)))
+    {}
+
+    uint64_t next_u64()
+    {
+        return splitmix64(key_ + 0x9e3779b97f4a7c15ull * ++counter_);
+    }
+
+    // [0, 1) with 24 bits of mantissa
+    float unit_float()
+    {
+        return static_cast<float>(next_u64() >> 40) * (1.f / 16777216.f);
+    }
+
+    float range(float low, float high)
+    {
+        return low + (high - low) * unit_float();
+    }
+
+private:
+    uint64_t key_;
+    uint64_t counter_{0};
+};
+} // namespace base
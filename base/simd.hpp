@@ -0,0 +1,90 @@
+#pragma once
+#include <immintrin.h>
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// msvc accepts any intrinsic in any function, gcc and clang need the isa
+// enabled per function so that the rest of the program stays baseline x86-64.
+// BASE_TARGET_AVX2_NO_FMA is for kernels that must give the bits of the
+// scalar code: without fma enabled gcc and clang can't contract a multiply
+// and an add, whatever -ffp-contract says, msvc never contracts intrinsics
+#if defined(_MSC_VER)
+#define BASE_TARGET_SSE41
+#define BASE_TARGET_AVX2
+#define BASE_TARGET_AVX2_NO_FMA
+#else
+#define BASE_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define BASE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define BASE_TARGET_AVX2_NO_FMA __attribute__((target("avx2")))
+#endif
+
+namespace base
+{
+enum Simd_level
+{
+    SIMD_SCALAR=0,
+    SIMD_SSE41=1,
+    SIMD_AVX2=2
+};
+
+void cpuid(int regs[4], int leaf, int subleaf)
+{
+#if defined(_MSC_VER)
+    __cpuidex(regs, leaf, subleaf);
+#else
+    unsigned int a, b, c, d;
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+    regs[0]=static_cast<int>(a);
+    regs[1]=static_cast<int>(b);
+    regs[2]=static_cast<int>(c);
+    regs[3]=static_cast<int>(d);
+#endif
+}
+
+uint64_t xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+// highest instruction set supported by both the cpu and the os
+Simd_level detect_simd_level()
+{
+    int regs[4];
+    cpuid(regs, 0, 0);
+    const int max_leaf=regs[0];
+    if (max_leaf < 1) return SIMD_SCALAR;
+
+    cpuid(regs, 1, 0);
+    const bool sse41=(regs[2] & (1 << 19)) != 0;
+    const bool fma=(regs[2] & (1 << 12)) != 0;
+    const bool osxsave=(regs[2] & (1 << 27)) != 0;
+    const bool avx=(regs[2] & (1 << 28)) != 0;
+    if (!sse41) return SIMD_SCALAR;
+
+    // the os must save the ymm registers on context switches
+    if (max_leaf >= 7 && osxsave && avx && fma && (xgetbv0() & 0x6) == 0x6) {
+        cpuid(regs, 7, 0);
+        if (regs[1] & (1 << 5)) return SIMD_AVX2;
+    }
+    return SIMD_SSE41;
+}
+
+const char *simd_level_str(Simd_level level)
+{
+    switch (level) {
+        case SIMD_AVX2:return "AVX2";
+        case SIMD_SSE41:return "SSE4.1";
+        default:return "scalar";
+    }
+}
+} // namespace base
@@ -0,0 +1,431 @@
+#pragma once
+#include "Grid.hpp"
+#include "grid_flags.hpp"
+#include "light_bounds.hpp"
+#include "depth_keys.glsl"
+#include <Thread_pool.hpp>
+#include <simd.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace cluster
+{
+// cpu build of the cluster light lists in the buffer layouts of the gpu
+// passes, used as a reference for them and to profile changes offline
+//
+//     flag_view_depths   clustering.frag               grid_flags
+//     calc_light_bounds  calc_light_grids.comp         light_bounds
+//     calc_light_counts  calc_light_grids.comp         grid_light_counts
+//     calc_grid_offsets  add_grid_block_offsets.comp   grid_light_count_total, grid_light_count_offsets
+//     calc_light_list    calc_light_list.comp          light_list
+//     calc_light_masks   calc_light_grids.comp         light_masks (LIGHT_MASKS variant)
+//     calc_depth_keys    calc_light_grids.comp         light_depth_keys (Z_BINS variant)
+//                        sort_light_depths.comp        light_depth_keys sorted
+//     calc_z_bins        calc_z_bins.comp              z_bins, tile_light_masks
+//     calc_linked_lists  calc_light_grids.comp         grid_light_heads, light_nodes (LINKED_LISTS variant)
+//     compact_light_lists compact_light_lists.comp     grid_light_counts, grid_light_count_offsets, light_list
+//
+// clusters get their offsets in grid index order like with the gpu prefix
+// sum (calc_grid_offsets.comp hands them out with atomics instead) and list
+// their lights by increasing index, where the gpu takes list slots with
+// atomics, so the result only depends on the input. grid_light_counts_compare
+// is not kept, it ends up equal to grid_light_counts for every listed cluster.
+class Cluster_builder
+{
+public:
+    explicit Cluster_builder(base::Thread_pool *p_pool, base::Simd_level level=base::detect_simd_level())
+        :p_pool_(p_pool)
+    {
+        set_simd_level(level);
+    }
+
+    base::Simd_level simd_level() const
+    {
+        return simd_level_;
+    }
+
+    void set_simd_level(base::Simd_level level)
+    {
+        simd_level_=level;
+        flag_depth_row_fn_=select_flag_depth_row_fn(level);
+        calc_light_bounds_fn_=select_calc_light_bounds_fn(level);
+    }
+
+    const Grid &grid() const
+    {
+        return grid_;
+    }
+
+    // new frame: camera, resolution or grid size, clears the flags
+    void set_grid(const Grid &grid)
+    {
+        grid_=grid;
+        grid_flags_.assign(grid_.cell_count(), 0);
+        grid_light_counts_.resize(grid_.cell_count());
+        grid_light_count_offsets_.resize(grid_.cell_count());
+    }
+
+    // flags the clusters of the visible surfaces, view_z is a width * height
+    // image of view space z with rows stride floats apart
+    void flag_view_depths(const float *p_view_z, uint32_t stride)
+    {
+        const uint32_t width=static_cast<uint32_t>(grid_.resolution.x);
+        const uint32_t height=static_cast<uint32_t>(grid_.resolution.y);
+        const uint32_t tile_height=static_cast<uint32_t>(grid_.tile_size.y);
+        // one tile row per chunk keeps the flag writes of threads apart
+        p_pool_->parallel_for(grid_.dim_y, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t y=begin * tile_height; y < std::min(height, end * tile_height); y++) {
+                flag_depth_row_fn_(grid_, p_view_z + static_cast<size_t>(y) * stride, y, 0, width, grid_flags_.data());
+            }
+        });
+    }
+
+    // all passes after the flags for light_count lights stored as
+    // vec4(position, range)
+    void build(const float *p_pos_ranges, uint32_t light_count)
+    {
+        calc_light_bounds(p_pos_ranges, light_count);
+        calc_light_counts();
+        calc_grid_offsets();
+        calc_light_list();
+    }
+
+    // the light masks instead of the counts, offsets and list
+    void build_masks(const float *p_pos_ranges, uint32_t light_count)
+    {
+        calc_light_bounds(p_pos_ranges, light_count);
+        calc_light_masks();
+    }
+
+    // the depth sorted lights, their z-bins and tile masks instead of the
+    // cluster lists, up to DEPTH_KEY_MAX_LIGHTS lights
+    void build_z_bins(const float *p_pos_ranges, uint32_t light_count)
+    {
+        calc_light_bounds(p_pos_ranges, light_count);
+        calc_depth_keys(p_pos_ranges);
+        std::sort(light_depth_keys_.begin(), light_depth_keys_.end());
+        calc_z_bins();
+    }
+
+    // per cluster lists of light nodes, then flattened into the light list
+    // when compact
+    void build_linked_lists(const float *p_pos_ranges, uint32_t light_count, bool compact)
+    {
+        calc_light_bounds(p_pos_ranges, light_count);
+        calc_linked_lists();
+        if (compact) compact_light_lists();
+    }
+
+    void calc_light_bounds(const float *p_pos_ranges, uint32_t light_count)
+    {
+        light_count_=light_count;
+        light_bounds_.resize(static_cast<size_t>(light_count) * 2);
+        if (refine_light_cells_) light_view_spheres_.resize(light_count);
+        p_pool_->parallel_for(light_count, LIGHT_GRAIN, [&](uint32_t begin, uint32_t end) {
+            calc_light_bounds_fn_(grid_, p_pos_ranges, begin, end, light_bounds_.data());
+            if (!refine_light_cells_) return;
+            for (uint32_t i=begin; i < end; i++) {
+                const float *p=p_pos_ranges + static_cast<size_t>(i) * 4;
+                light_view_spheres_[i]=glm::vec4(glm::vec3(grid_.view * glm::vec4(p[0], p[1], p[2], 1.f)), p[3]);
+            }
+        });
+    }
+
+    void calc_light_counts()
+    {
+        std::fill(grid_light_counts_.begin(), grid_light_counts_.end(), 0);
+        for_each_light_cell_([&](uint32_t, uint32_t grid_idx) {
+            grid_light_counts_[grid_idx]++;
+        });
+    }
+
+    // exclusive scan of the counts, clusters that don't fit the list
+    // capacity entirely lose their flag like in add_grid_block_offsets.comp
+    void calc_grid_offsets()
+    {
+        uint32_t total=0;
+        for (uint32_t grid_idx=0; grid_idx < grid_.cell_count(); grid_idx++) {
+            const uint32_t count=grid_light_counts_[grid_idx];
+            if (count == 0) continue;
+            if (total + count <= light_list_max_length_) grid_light_count_offsets_[grid_idx]=total;
+            else grid_flags_[grid_idx]=0;
+            total+=count;
+        }
+        grid_light_count_total_=total;
+    }
+
+    void calc_light_list()
+    {
+        light_list_.resize(light_list_max_length_);
+        cursors_.assign(grid_.cell_count(), 0);
+        for_each_light_cell_([&](uint32_t light_idx, uint32_t grid_idx) {
+            const uint32_t slot=grid_light_count_offsets_[grid_idx] + cursors_[grid_idx]++;
+            if (slot < light_list_max_length_) light_list_[slot]=light_idx;
+        });
+    }
+
+    // bit light % 32 of word light / 32 of the cluster's light_mask_words
+    void calc_light_masks()
+    {
+        light_mask_words_=(light_count_ + 31) / 32;
+        light_masks_.assign(static_cast<size_t>(grid_.cell_count()) * light_mask_words_, 0);
+        for_each_light_cell_([&](uint32_t light_idx, uint32_t grid_idx) {
+            light_masks_[static_cast<size_t>(grid_idx) * light_mask_words_ + light_idx / 32]|=1u << (light_idx % 32);
+        });
+    }
+
+    // view depth bits over the light index, skipped lights sort last
+    void calc_depth_keys(const float *p_pos_ranges)
+    {
+        light_depth_keys_.resize(light_count_);
+        for (uint32_t light_idx=0; light_idx < light_count_; light_idx++) {
+            glm::uvec3 b_min, b_max;
+            if (!unpack_light_bounds_(light_idx, b_min, b_max)) {
+                light_depth_keys_[light_idx]=SKIPPED_DEPTH_KEY | light_idx;
+                continue;
+            }
+            const float *p=p_pos_ranges + static_cast<size_t>(light_idx) * 4;
+            const float view_z=(grid_.view * glm::vec4(p[0], p[1], p[2], 1.f)).z;
+            const float depth=std::max(0.f, -view_z);
+            uint32_t bits;
+            memcpy(&bits, &depth, sizeof(bits));
+            light_depth_keys_[light_idx]=(bits & ~DEPTH_KEY_LIGHT_IDX_MASK) | light_idx;
+        }
+    }
+
+    // per z slice the first and last sorted slot as ~first, last + 1 so that
+    // 0 is empty, per tile bit slot % 32 of word slot / 32
+    void calc_z_bins()
+    {
+        light_mask_words_=(light_count_ + 31) / 32;
+        z_bins_.assign(static_cast<size_t>(grid_.dim_z) * 2, 0);
+        tile_light_masks_.assign(static_cast<size_t>(grid_.dim_x) * grid_.dim_y * light_mask_words_, 0);
+        for (uint32_t slot=0; slot < light_count_; slot++) {
+            const uint32_t light_idx=light_depth_keys_[slot] & DEPTH_KEY_LIGHT_IDX_MASK;
+            glm::uvec3 b_min, b_max;
+            if (!unpack_light_bounds_(light_idx, b_min, b_max)) continue;
+            for (uint32_t k=b_min.z; k <= b_max.z; k++) {
+                z_bins_[k * 2]=std::max(z_bins_[k * 2], ~slot);
+                z_bins_[k * 2 + 1]=std::max(z_bins_[k * 2 + 1], slot + 1);
+            }
+            for (uint32_t j=b_min.y; j <= b_max.y; j++) {
+                for (uint32_t i=b_min.x; i <= b_max.x; i++) {
+                    const size_t tile_idx=static_cast<size_t>(grid_.dim_x) * j + i;
+                    tile_light_masks_[tile_idx * light_mask_words_ + slot / 32]|=1u << (slot % 32);
+                }
+            }
+        }
+    }
+
+    // node n > 0 at words 2n (light) and 2n + 1 (next node, 0 ends the list),
+    // word 0 counts the nodes. the node numbers depend on the thread timing
+    // like on the gpu, each cluster lists its lights by decreasing index
+    void calc_linked_lists()
+    {
+        grid_light_heads_.assign(grid_.cell_count(), 0);
+        light_nodes_.resize((static_cast<size_t>(light_list_max_length_) + 1) * 2);
+        std::atomic<uint32_t> node_count{0};
+        for_each_light_cell_([&](uint32_t light_idx, uint32_t grid_idx) {
+            const uint32_t node=node_count.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (node > light_list_max_length_) return; // dropped
+            light_nodes_[node * 2]=light_idx;
+            light_nodes_[node * 2 + 1]=grid_light_heads_[grid_idx];
+            grid_light_heads_[grid_idx]=node;
+        });
+        light_nodes_[0]=node_count.load();
+    }
+
+    // counts, offsets and list of the linked lists in grid index order,
+    // clusters past the list capacity lose their flag
+    void compact_light_lists()
+    {
+        std::fill(grid_light_counts_.begin(), grid_light_counts_.end(), 0);
+        light_list_.resize(light_list_max_length_);
+        uint32_t total=0;
+        for (uint32_t grid_idx=0; grid_idx < grid_.cell_count(); grid_idx++) {
+            if (grid_flags_[grid_idx] != 1) continue;
+            uint32_t count=0;
+            for (uint32_t node=grid_light_heads_[grid_idx]; node != 0; node=light_nodes_[node * 2 + 1]) count++;
+            if (count == 0) continue;
+            if (total + count <= light_list_max_length_) {
+                grid_light_counts_[grid_idx]=count;
+                grid_light_count_offsets_[grid_idx]=total;
+                uint32_t slot=total;
+                for (uint32_t node=grid_light_heads_[grid_idx]; node != 0; node=light_nodes_[node * 2 + 1]) {
+                    light_list_[slot++]=light_nodes_[node * 2];
+                }
+            }
+            else {
+                grid_flags_[grid_idx]=0;
+            }
+            total+=count;
+        }
+        grid_light_count_total_=total;
+    }
+
+    // calls fn(light) for the lights cluster_forward.frag (z-bins variant)
+    // shades in cluster (i, j, k), in sorted slot order
+    template<typename Fn>
+    void for_each_z_bin_light(uint32_t i, uint32_t j, uint32_t k, Fn fn) const
+    {
+        if (z_bins_[k * 2] == 0) return;
+        const uint32_t first=~z_bins_[k * 2];
+        const uint32_t last=z_bins_[k * 2 + 1] - 1;
+        const uint32_t *p_mask=tile_light_masks_.data() + (static_cast<size_t>(grid_.dim_x) * j + i) * light_mask_words_;
+        for (uint32_t slot=first; slot <= last; slot++) {
+            if (p_mask[slot / 32] & (1u << (slot % 32))) fn(light_depth_keys_[slot] & DEPTH_KEY_LIGHT_IDX_MASK);
+        }
+    }
+
+    void set_light_list_max_length(uint32_t length)
+    {
+        light_list_max_length_=length;
+    }
+
+    // only the clusters in the light bounds whose aabb the light sphere
+    // touches, like the refine_light_cells push constant
+    void set_refine_light_cells(bool refine)
+    {
+        refine_light_cells_=refine;
+    }
+
+    uint32_t light_count() const
+    {
+        return light_count_;
+    }
+
+    const std::vector<uint8_t> &grid_flags() const
+    {
+        return grid_flags_;
+    }
+
+    const std::vector<uint32_t> &light_bounds() const
+    {
+        return light_bounds_;
+    }
+
+    const std::vector<uint32_t> &grid_light_counts() const
+    {
+        return grid_light_counts_;
+    }
+
+    uint32_t grid_light_count_total() const
+    {
+        return grid_light_count_total_;
+    }
+
+    const std::vector<uint32_t> &grid_light_count_offsets() const
+    {
+        return grid_light_count_offsets_;
+    }
+
+    const std::vector<uint32_t> &light_list() const
+    {
+        return light_list_;
+    }
+
+    uint32_t light_mask_words() const
+    {
+        return light_mask_words_;
+    }
+
+    const std::vector<uint32_t> &light_masks() const
+    {
+        return light_masks_;
+    }
+
+    const std::vector<uint32_t> &light_depth_keys() const
+    {
+        return light_depth_keys_;
+    }
+
+    const std::vector<uint32_t> &z_bins() const
+    {
+        return z_bins_;
+    }
+
+    const std::vector<uint32_t> &tile_light_masks() const
+    {
+        return tile_light_masks_;
+    }
+
+    const std::vector<uint32_t> &grid_light_heads() const
+    {
+        return grid_light_heads_;
+    }
+
+    const std::vector<uint32_t> &light_nodes() const
+    {
+        return light_nodes_;
+    }
+
+private:
+    static const uint32_t LIGHT_GRAIN=4096;
+    static const uint32_t SLICE_GRAIN=4;
+
+    base::Thread_pool *p_pool_;
+    base::Simd_level simd_level_{base::SIMD_SCALAR};
+    Flag_depth_row_fn flag_depth_row_fn_{flag_depth_row_scalar};
+    Calc_light_bounds_fn calc_light_bounds_fn_{calc_light_bounds_scalar};
+    Grid grid_;
+    uint32_t light_count_{0};
+    uint32_t light_list_max_length_{LIGHT_LIST_MAX_LENGTH};
+    bool refine_light_cells_{false};
+
+    std::vector<uint8_t> grid_flags_;
+    std::vector<uint32_t> light_bounds_;
+    std::vector<glm::vec4> light_view_spheres_; // refined light cells only
+    std::vector<uint32_t> grid_light_counts_;
+    uint32_t grid_light_count_total_{0};
+    std::vector<uint32_t> grid_light_count_offsets_;
+    std::vector<uint32_t> light_list_;
+    std::vector<uint32_t> cursors_; // list slots taken per cluster
+    uint32_t light_mask_words_{0}; // per cluster or tile
+    std::vector<uint32_t> light_masks_;
+    std::vector<uint32_t> light_depth_keys_;
+    std::vector<uint32_t> z_bins_;
+    std::vector<uint32_t> tile_light_masks_;
+    std::vector<uint32_t> grid_light_heads_;
+    std::vector<uint32_t> light_nodes_;
+
+    // the min and max grid coord of a light, false for the lights that miss
+    // the grid like in calc_light_list.comp
+    bool unpack_light_bounds_(uint32_t light_idx, glm::uvec3 &b_min, glm::uvec3 &b_max) const
+    {
+        const uint32_t *b=light_bounds_.data() + static_cast<size_t>(light_idx) * 2;
+        b_min=unpack_grid_coord(b[0]);
+        b_max=unpack_grid_coord(b[1]);
+        return b_min.x <= b_max.x;
+    }
+
+    // calls fn(light, cluster) for every flagged cluster inside the light
+    // bounds. threads own disjoint z slice ranges and walk the lights in
+    // index order, so fn never races and sees each cluster's lights sorted
+    template<typename Fn>
+    void for_each_light_cell_(Fn fn)
+    {
+        p_pool_->parallel_for(grid_.dim_z, SLICE_GRAIN, [&](uint32_t z_begin, uint32_t z_end) {
+            for (uint32_t light_idx=0; light_idx < light_count_; light_idx++) {
+                glm::uvec3 b_min, b_max;
+                if (!unpack_light_bounds_(light_idx, b_min, b_max)) continue;
+                const uint32_t k_min=std::max(b_min.z, z_begin);
+                const uint32_t k_max=std::min(b_max.z + 1, z_end);
+                for (uint32_t i=b_min.x; i <= b_max.x; i++) {
+                    for (uint32_t j=b_min.y; j <= b_max.y; j++) {
+                        const glm::vec4 slopes=refine_light_cells_ ? tile_view_slopes(grid_, i, j) : glm::vec4(0.f);
+                        for (uint32_t k=k_min; k < k_max; k++) {
+                            const uint32_t grid_idx=grid_coord_to_grid_idx(grid_, i, j, k);
+                            if (grid_flags_[grid_idx] != 1) continue;
+                            if (refine_light_cells_ && !sphere_intersects_cluster(grid_, light_view_spheres_[light_idx], slopes, k)) continue;
+                            fn(light_idx, grid_idx);
+                        }
+                    }
+                }
+            }
+        });
+    }
+};
+} // namespace cluster
@@ -0,0 +1,137 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "log.hpp"
+#include <cmath>
+#include <cstdint>
+
+namespace cluster
+{
+// the #defines of the clustering shaders
+const uint32_t GRID_DIM_Z=256;
+const float CAM_NEAR=0.1f;
+const uint32_t LIGHT_LIST_MAX_LENGTH=1024 * 1024;
+
+// cluster grid of one frame: screen tiles times logarithmic view depth slices,
+// the same state the shaders read from the global uniforms
+struct Grid
+{
+    glm::mat4 view{1.f};
+    glm::mat4 projection_clip{1.f};
+    glm::vec2 resolution{0.f};
+    glm::vec2 tile_size{64.f};
+    uint32_t dim_x{0};
+    uint32_t dim_y{0};
+    uint32_t dim_z{GRID_DIM_Z};
+    float cam_near{CAM_NEAR};
+    float cam_far{1.f};
+
+    // tiles are whole pixels so that every pixel row belongs to one tile row
+    void set_resolution(uint32_t width, uint32_t height, uint32_t tile_width, uint32_t tile_height)
+    {
+        resolution=glm::vec2(static_cast<float>(width), static_cast<float>(height));
+        tile_size=glm::vec2(static_cast<float>(tile_width), static_cast<float>(tile_height));
+        dim_x=(width - 1) / tile_width + 1;
+        dim_y=(height - 1) / tile_height + 1;
+    }
+
+    uint32_t cell_count() const
+    {
+        return dim_x * dim_y * dim_z;
+    }
+};
+
+uint32_t grid_coord_to_grid_idx(const Grid &grid, uint32_t i, uint32_t j, uint32_t k)
+{
+    return grid.dim_x * grid.dim_y * k + grid.dim_x * j + i;
+}
+
+// z slice of a view space depth, as a float so callers can truncate
+float view_z_to_grid_z(const Grid &grid, float view_z)
+{
+    // log(x < 1) only ever ends up in the max(0, ...) clamp
+    float a=(-view_z - grid.cam_near) / (grid.cam_far - grid.cam_near) + 1.f;
+    a=a > 1.f ? a : 1.f;
+    float z=static_cast<float>(grid.dim_z) * log_scalar(a);
+    const float z_max=static_cast<float>(grid.dim_z - 1);
+    return z < z_max ? z : z_max;
+}
+
+BASE_TARGET_SSE41
+__m128 view_z_to_grid_z_sse41(const Grid &grid, __m128 view_z)
+{
+    __m128 a=_mm_sub_ps(_mm_xor_ps(view_z, _mm_set1_ps(-0.f)), _mm_set1_ps(grid.cam_near));
+    a=_mm_add_ps(_mm_div_ps(a, _mm_set1_ps(grid.cam_far - grid.cam_near)), _mm_set1_ps(1.f));
+    a=_mm_max_ps(a, _mm_set1_ps(1.f));
+    __m128 z=_mm_mul_ps(_mm_set1_ps(static_cast<float>(grid.dim_z)), log_sse41(a));
+    return _mm_min_ps(z, _mm_set1_ps(static_cast<float>(grid.dim_z - 1)));
+}
+
+BASE_TARGET_AVX2_NO_FMA
+__m256 view_z_to_grid_z_avx2(const Grid &grid, __m256 view_z)
+{
+    __m256 a=_mm256_sub_ps(_mm256_xor_ps(view_z, _mm256_set1_ps(-0.f)), _mm256_set1_ps(grid.cam_near));
+    a=_mm256_add_ps(_mm256_div_ps(a, _mm256_set1_ps(grid.cam_far - grid.cam_near)), _mm256_set1_ps(1.f));
+    a=_mm256_max_ps(a, _mm256_set1_ps(1.f));
+    __m256 z=_mm256_mul_ps(_mm256_set1_ps(static_cast<float>(grid.dim_z)), log_avx2(a));
+    return _mm256_min_ps(z, _mm256_set1_ps(static_cast<float>(grid.dim_z - 1)));
+}
+
+// view space position to window coordinates
+glm::vec2 view_pos_to_frag_pos(const Grid &grid, const glm::vec3 &view_pos)
+{
+    const glm::mat4 &m=grid.projection_clip;
+    float x=m[0][0] * view_pos.x + m[1][0] * view_pos.y + m[2][0] * view_pos.z + m[3][0];
+    float y=m[0][1] * view_pos.x + m[1][1] * view_pos.y + m[2][1] * view_pos.z + m[3][1];
+    float w=m[0][3] * view_pos.x + m[1][3] * view_pos.y + m[2][3] * view_pos.z + m[3][3];
+    return glm::vec2(0.5f * (1.f + x / w) * grid.resolution.x, 0.5f * (1.f + y / w) * grid.resolution.y);
+}
+
+// view space slopes of tile (i, j), view xy = depth * slope with depth =
+// -view_z, the inverse of view_pos_to_frag_pos. xy: min, zw: max
+glm::vec4 tile_view_slopes(const Grid &grid, uint32_t i, uint32_t j)
+{
+    const glm::mat4 &m=grid.projection_clip;
+    const glm::vec2 ndc_min=2.f * glm::vec2(static_cast<float>(i), static_cast<float>(j)) * grid.tile_size / grid.resolution - 1.f;
+    const glm::vec2 ndc_max=2.f * glm::vec2(static_cast<float>(i + 1), static_cast<float>(j + 1)) * grid.tile_size / grid.resolution - 1.f;
+    const glm::vec2 scale(m[0][0], m[1][1]);
+    const glm::vec2 offset(m[2][0], m[2][1]);
+    const glm::vec2 a=(ndc_min + offset) / scale;
+    const glm::vec2 b=(ndc_max + offset) / scale;
+    return glm::vec4(glm::min(a, b), glm::max(a, b));
+}
+
+// view depth where z slice k starts, the inverse of view_z_to_grid_z
+float grid_z_to_depth(const Grid &grid, uint32_t k)
+{
+    return grid.cam_near + (expf(static_cast<float>(k) / static_cast<float>(grid.dim_z)) - 1.f) * (grid.cam_far - grid.cam_near);
+}
+
+// light sphere (view space pos, range) against the view space aabb of the
+// frustum of cluster (i, j, k) with slopes of tile (i, j)
+bool sphere_intersects_cluster(const Grid &grid, const glm::vec4 &view_sphere, const glm::vec4 &slopes, uint32_t k)
+{
+    const float depth_near=grid_z_to_depth(grid, k);
+    const float depth_far=grid_z_to_depth(grid, k + 1);
+    const glm::vec2 xy_min=glm::min(glm::vec2(slopes.x, slopes.y) * depth_near, glm::vec2(slopes.x, slopes.y) * depth_far);
+    const glm::vec2 xy_max=glm::max(glm::vec2(slopes.z, slopes.w) * depth_near, glm::vec2(slopes.z, slopes.w) * depth_far);
+    const glm::vec3 aabb_min(xy_min, -depth_far);
+    const glm::vec3 aabb_max(xy_max, -depth_near);
+    const glm::vec3 c(view_sphere);
+    const glm::vec3 d=glm::max(glm::vec3(0.f), glm::max(aabb_min - c, c - aabb_max));
+    return glm::dot(d, d) <= view_sphere.w * view_sphere.w;
+}
+
+// calc_light_grids.comp
+glm::vec3 view_pos_to_grid_coord(const Grid &grid, const glm::vec2 &frag_pos, float view_z)
+{
+    return glm::vec3(frag_pos.x / grid.tile_size.x, frag_pos.y / grid.tile_size.y, view_z_to_grid_z(grid, view_z));
+}
+
+// clustering.frag, frag_pos is a pixel center
+glm::uvec3 frag_pos_to_grid_coord(const Grid &grid, const glm::vec2 &frag_pos, float view_z)
+{
+    return glm::uvec3(static_cast<uint32_t>((frag_pos.x - 0.5f) / grid.tile_size.x),
+                      static_cast<uint32_t>((frag_pos.y - 0.5f) / grid.tile_size.y),
+                      static_cast<uint32_t>(view_z_to_grid_z(grid, view_z)));
+}
+} // namespace cluster
@@ -0,0 +1,512 @@
+#include "Cluster_builder.hpp"
+#include <Camera.hpp>
+#include <random.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Cluster_builder on a synthetic frame with every simd level and with one
+// and several threads, the buffers must not differ from the scalar single
+// thread build. sphere_ndc_bounds against points sampled in the spheres.
+// --bench times the passes instead, --lights n sets the light count. exits
+// with 1 on a mismatch
+
+const uint32_t WIDTH=1280;
+const uint32_t HEIGHT=720;
+const uint32_t TILE_SIZE=64;
+const uint32_t MASK_LIGHTS=2048; // light masks and z-bins
+const uint32_t NEAR_LIGHTS=512; // around the camera, cut by the near plane
+const uint32_t BENCH_ROUNDS=10;
+const uint32_t TEST_SPHERE_COUNT=20000; // a multiple of 8
+const uint32_t SPHERE_SAMPLES=1024;
+const float SPHERE_BOUNDS_EPSILON=1e-4f; // relative ndc rounding
+const float SPHERE_BOUNDS_SLACK=0.05f; // of the ndc size, fully visible spheres
+
+struct Scene
+{
+    cluster::Grid grid;
+    std::vector<float> view_z;
+    uint32_t stride{WIDTH + 3}; // rows are not simd aligned
+    std::vector<float> pos_ranges; // vec4(position, range) per light
+    uint32_t light_count{0};
+};
+
+// a camera above a field of lights, a depth image of a wavy surface below
+// a band without geometry
+void init_scene(Scene &scene, uint32_t light_count)
+{
+    base::Camera camera(glm::vec3(0.f, 12.f, -70.f), glm::vec3(0.f));
+    camera.cam_far=200.f;
+    camera.update_aspect(WIDTH, HEIGHT);
+
+    cluster::Grid &grid=scene.grid;
+    grid.view=camera.view;
+    grid.projection_clip=camera.clip * camera.projection;
+    grid.set_resolution(WIDTH, HEIGHT, TILE_SIZE, TILE_SIZE);
+    grid.cam_near=camera.cam_near;
+    grid.cam_far=camera.cam_far;
+
+    scene.view_z.assign(static_cast<size_t>(scene.stride) * HEIGHT, 0.f);
+    for (uint32_t y=0; y < HEIGHT; y++) {
+        const float v=static_cast<float>(y) / HEIGHT;
+        if (v < 0.2f) continue;
+        for (uint32_t x=0; x < WIDTH; x++) {
+            const float u=static_cast<float>(x) / WIDTH;
+            const float depth=1.f + 150.f * (1.f - v) * (0.6f + 0.4f * sinf(17.f * u) * cosf(11.f * v));
+            scene.view_z[static_cast<size_t>(y) * scene.stride + x]=-depth;
+        }
+    }
+
+    scene.light_count=light_count;
+    scene.pos_ranges.resize(static_cast<size_t>(light_count) * 4);
+    for (uint32_t i=0; i < light_count; i++) {
+        base::Random rng(0x434c5553ull, i);
+        float *p=scene.pos_ranges.data() + static_cast<size_t>(i) * 4;
+        if (i < NEAR_LIGHTS) {
+            p[0]=camera.eye_pos.x + rng.range(-2.f, 2.f);
+            p[1]=camera.eye_pos.y + rng.range(-2.f, 2.f);
+            p[2]=camera.eye_pos.z + rng.range(-2.f, 2.f);
+            p[3]=rng.range(0.05f, 3.f);
+        }
+        else {
+            p[0]=rng.range(-80.f, 80.f);
+            p[1]=rng.range(-5.f, 20.f);
+            p[2]=rng.range(-80.f, 120.f);
+            p[3]=rng.range(0.5f, 6.f);
+        }
+    }
+}
+
+BASE_TARGET_SSE41
+void sphere_ndc_bounds_sse41_batches(const float *p_x, const float *p_y, const float *p_z, const float *p_r,
+                                     float cam_near, const glm::mat4 &projection, glm::vec4 *p_out)
+{
+    for (uint32_t i=0; i < TEST_SPHERE_COUNT; i+=4) {
+        __m128 b[4];
+        cluster::sphere_ndc_bounds_sse41(_mm_loadu_ps(p_x + i), _mm_loadu_ps(p_y + i), _mm_loadu_ps(p_z + i), _mm_loadu_ps(p_r + i),
+                                         cam_near, projection, b[0], b[1], b[2], b[3]);
+        _MM_TRANSPOSE4_PS(b[0], b[1], b[2], b[3]);
+        for (int k=0; k < 4; k++) _mm_storeu_ps(&p_out[i + k].x, b[k]);
+    }
+}
+
+BASE_TARGET_AVX2_NO_FMA
+void sphere_ndc_bounds_avx2_batches(const float *p_x, const float *p_y, const float *p_z, const float *p_r,
+                                    float cam_near, const glm::mat4 &projection, glm::vec4 *p_out)
+{
+    for (uint32_t i=0; i < TEST_SPHERE_COUNT; i+=8) {
+        __m256 b[4];
+        cluster::sphere_ndc_bounds_avx2(_mm256_loadu_ps(p_x + i), _mm256_loadu_ps(p_y + i), _mm256_loadu_ps(p_z + i), _mm256_loadu_ps(p_r + i),
+                                        cam_near, projection, b[0], b[1], b[2], b[3]);
+        alignas(32) float lanes[4][8];
+        for (int c=0; c < 4; c++) _mm256_store_ps(lanes[c], b[c]);
+        for (int k=0; k < 8; k++) p_out[i + k]=glm::vec4(lanes[0][k], lanes[1][k], lanes[2][k], lanes[3][k]);
+    }
+}
+
+// random view space spheres with a part past the near plane: a third cut by
+// the near plane, some holding the eye, the rest anywhere in the frustum
+// and around it
+void gen_test_spheres(float cam_near, std::vector<glm::vec4> &spheres)
+{
+    spheres.resize(TEST_SPHERE_COUNT);
+    for (uint32_t i=0; i < TEST_SPHERE_COUNT; i++) {
+        base::Random rng(0x53504852ull, i);
+        const float r=i % 8 == 0 ? rng.range(0.001f, 0.05f) : rng.range(0.05f, 10.f);
+        glm::vec3 c(rng.range(-30.f, 30.f), rng.range(-30.f, 30.f), 0.f);
+        if (i % 3 == 0) {
+            c.z=-cam_near + rng.range(-r, r);
+        }
+        else if (i % 16 == 1) {
+            c=glm::vec3(rng.range(-r, r), rng.range(-r, r), rng.range(-r, r)) * 0.5f;
+        }
+        else {
+            c.z=rng.range(-150.f, 5.f);
+            c.z=std::min(c.z, -cam_near + 0.99f * r);
+        }
+        spheres[i]=glm::vec4(c, r);
+    }
+}
+
+// points in the ball and on its surface past the near plane project inside
+// the bounds, for spheres in front of the near plane the bounds also touch
+// the samples. the simd paths give the same bits
+bool test_sphere_bounds(const Scene &scene)
+{
+    const float cam_near=scene.grid.cam_near;
+    const glm::mat4 &projection=scene.grid.projection_clip;
+    std::vector<glm::vec4> spheres;
+    gen_test_spheres(cam_near, spheres);
+
+    uint32_t outside=0, loose=0, sample_count=0;
+    for (uint32_t i=0; i < TEST_SPHERE_COUNT; i++) {
+        const glm::vec3 c(spheres[i]);
+        const float r=spheres[i].w;
+        const glm::vec4 b=cluster::sphere_ndc_bounds(c, r, cam_near, projection);
+        glm::vec2 sample_min(1e30f), sample_max(-1e30f);
+
+        base::Random rng(0x53414d50ull, i);
+        for (uint32_t s=0; s < SPHERE_SAMPLES; s++) {
+            const float dir_z=rng.range(-1.f, 1.f);
+            const float phi=rng.range(0.f, 6.2831853f);
+            const float dir_xy=sqrtf(std::max(0.f, 1.f - dir_z * dir_z));
+            const float len=s % 2 ? r : r * cbrtf(rng.unit_float());
+            const glm::vec3 p=c + len * glm::vec3(dir_xy * cosf(phi), dir_xy * sinf(phi), dir_z);
+            if (p.z > -cam_near) continue;
+
+            const glm::vec4 clip=projection * glm::vec4(p, 1.f);
+            const glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+            const glm::vec2 eps=SPHERE_BOUNDS_EPSILON * glm::max(glm::vec2(1.f), glm::vec2(std::fabs(ndc.x), std::fabs(ndc.y)));
+            sample_count++;
+            sample_min=glm::min(sample_min, ndc);
+            sample_max=glm::max(sample_max, ndc);
+            if (ndc.x < b.x - eps.x || ndc.x > b.z + eps.x || ndc.y < b.y - eps.y || ndc.y > b.w + eps.y) {
+                if (outside++ == 0) {
+                    printf("    sphere (%g, %g, %g) r %g: sample ndc (%g, %g) outside (%g, %g, %g, %g)\n",
+                           c.x, c.y, c.z, r, ndc.x, ndc.y, b.x, b.y, b.z, b.w);
+                }
+            }
+        }
+
+        // the samples reach the tangent points only on fully visible spheres,
+        // and get sparse where the projection stretches far off screen
+        if (c.z + r >= -cam_near || glm::dot(c, c) <= r * r) continue;
+        if (std::min(b.x, b.y) < -2.f || std::max(b.z, b.w) > 2.f) continue;
+        const glm::vec2 slack=SPHERE_BOUNDS_SLACK * glm::vec2(b.z - b.x, b.w - b.y) + SPHERE_BOUNDS_EPSILON;
+        if (sample_min.x - b.x > slack.x || b.z - sample_max.x > slack.x ||
+            sample_min.y - b.y > slack.y || b.w - sample_max.y > slack.y) {
+            if (loose++ == 0) {
+                printf("    sphere (%g, %g, %g) r %g: samples (%g, %g, %g, %g) inside (%g, %g, %g, %g)\n",
+                       c.x, c.y, c.z, r, sample_min.x, sample_min.y, sample_max.x, sample_max.y, b.x, b.y, b.z, b.w);
+            }
+        }
+    }
+    bool ok=outside == 0 && loose == 0;
+    printf("sphere bounds: %u spheres, %u samples, %u outside, %u loose: %s\n",
+           TEST_SPHERE_COUNT, sample_count, outside, loose, ok ? "ok" : "FAILED");
+
+    // soa batches of 8
+    std::vector<float> c_x(TEST_SPHERE_COUNT), c_y(TEST_SPHERE_COUNT), c_z(TEST_SPHERE_COUNT), r(TEST_SPHERE_COUNT);
+    std::vector<glm::vec4> ref(TEST_SPHERE_COUNT);
+    for (uint32_t i=0; i < TEST_SPHERE_COUNT; i++) {
+        c_x[i]=spheres[i].x;
+        c_y[i]=spheres[i].y;
+        c_z[i]=spheres[i].z;
+        r[i]=spheres[i].w;
+        ref[i]=cluster::sphere_ndc_bounds(glm::vec3(spheres[i]), spheres[i].w, cam_near, projection);
+    }
+    // the simd ports must land in the same grid cell, a build that enables
+    // fma for the whole program may contract the scalar code
+    const glm::vec2 cell_ndc(2.f * TILE_SIZE / WIDTH, 2.f * TILE_SIZE / HEIGHT);
+    auto same_cells=[&](const std::vector<glm::vec4> &out) {
+        for (uint32_t i=0; i < TEST_SPHERE_COUNT; i++) {
+            for (int c=0; c < 4; c++) {
+                if (!(std::fabs(out[i][c] - ref[i][c]) < cell_ndc[c % 2])) return false;
+            }
+        }
+        return true;
+    };
+    const base::Simd_level detected=base::detect_simd_level();
+    if (detected >= base::SIMD_SSE41) {
+        std::vector<glm::vec4> out(TEST_SPHERE_COUNT);
+        sphere_ndc_bounds_sse41_batches(c_x.data(), c_y.data(), c_z.data(), r.data(), cam_near, projection, out.data());
+        const bool same=same_cells(out);
+        printf("sphere bounds SSE4.1: %s\n", same ? "ok" : "FAILED");
+        ok=ok && same;
+    }
+    if (detected >= base::SIMD_AVX2) {
+        std::vector<glm::vec4> out(TEST_SPHERE_COUNT);
+        sphere_ndc_bounds_avx2_batches(c_x.data(), c_y.data(), c_z.data(), r.data(), cam_near, projection, out.data());
+        const bool same=same_cells(out);
+        printf("sphere bounds AVX2: %s\n", same ? "ok" : "FAILED");
+        ok=ok && same;
+    }
+    return ok;
+}
+
+// the buffers of one builder configuration
+struct Result
+{
+    std::vector<uint8_t> grid_flags;
+    std::vector<uint32_t> light_bounds;
+    std::vector<uint32_t> grid_light_counts;
+    std::vector<uint32_t> grid_light_count_offsets; // of the listed clusters
+    std::vector<uint32_t> light_list;
+    std::vector<uint32_t> refined_light_counts;
+    std::vector<uint32_t> refined_light_list;
+    std::vector<uint32_t> light_masks;
+    std::vector<uint32_t> light_depth_keys;
+    std::vector<uint32_t> z_bins;
+    std::vector<uint32_t> tile_light_masks;
+    uint32_t grid_light_count_total{0};
+};
+
+// the used part of the list, the offsets of the clusters that have lights
+void get_list(const cluster::Cluster_builder &builder,
+              std::vector<uint32_t> &counts,
+              std::vector<uint32_t> &offsets,
+              std::vector<uint32_t> &list)
+{
+    counts=builder.grid_light_counts();
+    offsets.assign(counts.size(), 0);
+    for (size_t grid_idx=0; grid_idx < counts.size(); grid_idx++) {
+        if (counts[grid_idx] && builder.grid_flags()[grid_idx] == 1) offsets[grid_idx]=builder.grid_light_count_offsets()[grid_idx];
+    }
+    const uint32_t length=std::min(builder.grid_light_count_total(), static_cast<uint32_t>(builder.light_list().size()));
+    list.assign(builder.light_list().begin(), builder.light_list().begin() + length);
+}
+
+template<typename T>
+bool check_equal(const char *p_name, const std::vector<T> &ref, const std::vector<T> &out)
+{
+    if (ref.size() != out.size()) {
+        printf("    %s: %zu elements instead of %zu\n", p_name, out.size(), ref.size());
+        return false;
+    }
+    for (size_t i=0; i < ref.size(); i++) {
+        if (ref[i] != out[i]) {
+            printf("    %s[%zu]: %u instead of %u\n", p_name, i, static_cast<uint32_t>(out[i]), static_cast<uint32_t>(ref[i]));
+            return false;
+        }
+    }
+    return true;
+}
+
+// the node lists of every cluster hold the lights of its light list
+// segment, in any order
+bool check_linked_lists(const cluster::Cluster_builder &builder, const Result &ref)
+{
+    const std::vector<uint32_t> &heads=builder.grid_light_heads();
+    const std::vector<uint32_t> &nodes=builder.light_nodes();
+    if (nodes[0] != ref.grid_light_count_total) {
+        printf("    light_nodes[0]: %u instead of %u\n", nodes[0], ref.grid_light_count_total);
+        return false;
+    }
+    std::vector<uint32_t> lights;
+    for (size_t grid_idx=0; grid_idx < heads.size(); grid_idx++) {
+        lights.clear();
+        for (uint32_t node=heads[grid_idx]; node != 0; node=nodes[node * 2 + 1]) lights.push_back(nodes[node * 2]);
+        std::sort(lights.begin(), lights.end());
+        const uint32_t count=ref.grid_light_counts[grid_idx];
+        const uint32_t *p_ref=ref.light_list.data() + ref.grid_light_count_offsets[grid_idx];
+        if (lights.size() != count || !std::equal(lights.begin(), lights.end(), p_ref)) {
+            printf("    linked list of cluster %zu: %zu lights instead of %u\n", grid_idx, lights.size(), count);
+            return false;
+        }
+    }
+    return true;
+}
+
+// the compacted lists have the counts and offsets of the light list, each
+// segment holds the same lights in node order
+bool check_compacted_lists(const cluster::Cluster_builder &builder, const Result &ref)
+{
+    std::vector<uint32_t> counts, offsets, list;
+    get_list(builder, counts, offsets, list);
+    bool ok=check_equal("compacted grid_light_counts", ref.grid_light_counts, counts);
+    ok=ok && check_equal("compacted grid_light_count_offsets", ref.grid_light_count_offsets, offsets);
+    if (!ok) return false;
+    for (size_t grid_idx=0; grid_idx < counts.size(); grid_idx++) {
+        std::sort(list.begin() + offsets[grid_idx], list.begin() + offsets[grid_idx] + counts[grid_idx]);
+    }
+    return check_equal("compacted light_list", ref.light_list, list);
+}
+
+// every build of the builder from a new grid, the masks and z-bins with the
+// first MASK_LIGHTS lights
+void run_builds(cluster::Cluster_builder &builder, const Scene &scene, Result &result)
+{
+    const uint32_t mask_lights=std::min(scene.light_count, MASK_LIGHTS);
+
+    builder.set_refine_light_cells(false);
+    builder.set_grid(scene.grid);
+    builder.flag_view_depths(scene.view_z.data(), scene.stride);
+    result.grid_flags=builder.grid_flags();
+    builder.build(scene.pos_ranges.data(), scene.light_count);
+    result.light_bounds=builder.light_bounds();
+    result.grid_light_count_total=builder.grid_light_count_total();
+    get_list(builder, result.grid_light_counts, result.grid_light_count_offsets, result.light_list);
+
+    std::vector<uint32_t> offsets;
+    builder.set_refine_light_cells(true);
+    builder.set_grid(scene.grid);
+    builder.flag_view_depths(scene.view_z.data(), scene.stride);
+    builder.build(scene.pos_ranges.data(), scene.light_count);
+    get_list(builder, result.refined_light_counts, offsets, result.refined_light_list);
+    builder.set_refine_light_cells(false);
+
+    builder.set_grid(scene.grid);
+    builder.flag_view_depths(scene.view_z.data(), scene.stride);
+    builder.build_masks(scene.pos_ranges.data(), mask_lights);
+    result.light_masks=builder.light_masks();
+
+    builder.set_grid(scene.grid);
+    builder.flag_view_depths(scene.view_z.data(), scene.stride);
+    builder.build_z_bins(scene.pos_ranges.data(), mask_lights);
+    result.light_depth_keys=builder.light_depth_keys();
+    result.z_bins=builder.z_bins();
+    result.tile_light_masks=builder.tile_light_masks();
+}
+
+bool check_results(const Result &ref, const Result &out)
+{
+    bool ok=check_equal("grid_flags", ref.grid_flags, out.grid_flags);
+    ok=check_equal("light_bounds", ref.light_bounds, out.light_bounds) && ok;
+    if (ref.grid_light_count_total != out.grid_light_count_total) {
+        printf("    grid_light_count_total: %u instead of %u\n", out.grid_light_count_total, ref.grid_light_count_total);
+        ok=false;
+    }
+    ok=check_equal("grid_light_counts", ref.grid_light_counts, out.grid_light_counts) && ok;
+    ok=check_equal("grid_light_count_offsets", ref.grid_light_count_offsets, out.grid_light_count_offsets) && ok;
+    ok=check_equal("light_list", ref.light_list, out.light_list) && ok;
+    ok=check_equal("refined grid_light_counts", ref.refined_light_counts, out.refined_light_counts) && ok;
+    ok=check_equal("refined light_list", ref.refined_light_list, out.refined_light_list) && ok;
+    ok=check_equal("light_masks", ref.light_masks, out.light_masks) && ok;
+    ok=check_equal("light_depth_keys", ref.light_depth_keys, out.light_depth_keys) && ok;
+    ok=check_equal("z_bins", ref.z_bins, out.z_bins) && ok;
+    ok=check_equal("tile_light_masks", ref.tile_light_masks, out.tile_light_masks) && ok;
+    return ok;
+}
+
+// the linked list build against the light list of the same configuration
+bool check_linked_list_builds(cluster::Cluster_builder &builder, const Scene &scene, const Result &ref)
+{
+    builder.set_grid(scene.grid);
+    builder.flag_view_depths(scene.view_z.data(), scene.stride);
+    builder.build_linked_lists(scene.pos_ranges.data(), scene.light_count, false);
+    bool ok=check_linked_lists(builder, ref);
+
+    builder.set_grid(scene.grid);
+    builder.flag_view_depths(scene.view_z.data(), scene.stride);
+    builder.build_linked_lists(scene.pos_ranges.data(), scene.light_count, true);
+    return check_compacted_lists(builder, ref) && ok;
+}
+
+// a list of half the demand keeps only the clusters that fit it entirely
+bool check_list_capacity(const Scene &scene, const Result &ref)
+{
+    base::Thread_pool single(0);
+    cluster::Cluster_builder builder(&single, base::SIMD_SCALAR);
+    const uint32_t capacity=ref.grid_light_count_total / 2;
+    builder.set_light_list_max_length(capacity);
+    builder.set_grid(scene.grid);
+    builder.flag_view_depths(scene.view_z.data(), scene.stride);
+    builder.build(scene.pos_ranges.data(), scene.light_count);
+    const std::vector<uint8_t> &flags=builder.grid_flags();
+    bool ok=builder.grid_light_count_total() == ref.grid_light_count_total;
+    for (size_t grid_idx=0; grid_idx < flags.size(); grid_idx++) {
+        const uint32_t count=builder.grid_light_counts()[grid_idx];
+        if (count && flags[grid_idx] == 1 && builder.grid_light_count_offsets()[grid_idx] + count > capacity) {
+            printf("    cluster %zu: list segment past the capacity %u\n", grid_idx, capacity);
+            ok=false;
+        }
+    }
+    printf("light list capacity %u: %s\n", capacity, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int run_tests(const Scene &scene, base::Thread_pool &single, base::Thread_pool &multi)
+{
+    const base::Simd_level detected=base::detect_simd_level();
+    cluster::Cluster_builder ref_builder(&single, base::SIMD_SCALAR);
+    Result ref;
+    run_builds(ref_builder, scene, ref);
+    printf("lights: %u, listed: %u, flagged clusters: %zu of %u\n",
+           scene.light_count, ref.grid_light_count_total,
+           static_cast<size_t>(std::count(ref.grid_flags.begin(), ref.grid_flags.end(), 1)), scene.grid.cell_count());
+
+    bool ok=test_sphere_bounds(scene);
+    ok=check_list_capacity(scene, ref) && ok;
+    base::Thread_pool *pools[]={&single, &multi};
+    for (int level=base::SIMD_SCALAR; level <= base::SIMD_AVX2; level++) {
+        const base::Simd_level simd_level=static_cast<base::Simd_level>(level);
+        if (simd_level > detected) {
+            printf("%s: not supported, skipped\n", base::simd_level_str(simd_level));
+            continue;
+        }
+        for (base::Thread_pool *p_pool : pools) {
+            cluster::Cluster_builder builder(p_pool, simd_level);
+            Result out;
+            run_builds(builder, scene, out);
+            bool run_ok=check_results(ref, out);
+            run_ok=check_linked_list_builds(builder, scene, out) && run_ok;
+            printf("%s, %u threads: %s\n", base::simd_level_str(simd_level), p_pool->thread_count(), run_ok ? "ok" : "FAILED");
+            ok=ok && run_ok;
+        }
+    }
+    printf(ok ? "passed\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
+
+// best time of the passes over BENCH_ROUNDS frames per configuration
+int run_bench(const Scene &scene, base::Thread_pool &single, base::Thread_pool &multi)
+{
+    const char *stage_names[]={"flags", "bounds", "counts", "offsets", "list", "linked", "compact"};
+    const int STAGE_COUNT=sizeof(stage_names) / sizeof(stage_names[0]);
+    printf("lights: %u, %ux%u, %ux%ux%u clusters, ms\n",
+           scene.light_count, WIDTH, HEIGHT, scene.grid.dim_x, scene.grid.dim_y, scene.grid.dim_z);
+    printf("%-16s", "");
+    for (const char *p_name : stage_names) printf("%9s", p_name);
+    printf("\n");
+
+    base::Thread_pool *pools[]={&single, &multi};
+    for (int level=base::SIMD_SCALAR; level <= base::detect_simd_level(); level++) {
+        for (base::Thread_pool *p_pool : pools) {
+            cluster::Cluster_builder builder(p_pool, static_cast<base::Simd_level>(level));
+            double best[STAGE_COUNT];
+            std::fill(best, best + STAGE_COUNT, 1e30);
+            for (uint32_t round=0; round < BENCH_ROUNDS; round++) {
+                auto t=std::chrono::steady_clock::now();
+                int stage=0;
+                auto lap=[&]() {
+                    const auto now=std::chrono::steady_clock::now();
+                    best[stage]=std::min(best[stage], std::chrono::duration<double, std::milli>(now - t).count());
+                    stage++;
+                    t=now;
+                };
+                builder.set_grid(scene.grid);
+                t=std::chrono::steady_clock::now();
+                builder.flag_view_depths(scene.view_z.data(), scene.stride);
+                lap();
+                builder.calc_light_bounds(scene.pos_ranges.data(), scene.light_count);
+                lap();
+                builder.calc_light_counts();
+                lap();
+                builder.calc_grid_offsets();
+                lap();
+                builder.calc_light_list();
+                lap();
+                builder.calc_linked_lists();
+                lap();
+                builder.compact_light_lists();
+                lap();
+            }
+            char label[32];
+            snprintf(label, sizeof(label), "%s x%u", base::simd_level_str(static_cast<base::Simd_level>(level)), p_pool->thread_count());
+            printf("%-16s", label);
+            for (double ms : best) printf("%9.3f", ms);
+            printf("\n");
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool bench=false;
+    uint32_t light_count=100003; // a partial simd block
+    for (int i=1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) bench=true;
+        if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) light_count=static_cast<uint32_t>(atoi(argv[++i]));
+    }
+
+    Scene scene;
+    init_scene(scene, light_count);
+    base::Thread_pool single(0);
+    base::Thread_pool multi(std::max(3u, base::Thread_pool::default_worker_count()));
+    return bench ? run_bench(scene, single, multi) : run_tests(scene, single, multi);
+}
@@ -0,0 +1,11 @@
+// depth keys of the z-bins: the top bits of the positive view depth float,
+// which order like the float, over the light index. shared by the z-bins
+// shaders, Cluster_builder and Prog_info::MAX_Z_BIN_LIGHTS, the defines
+// also compile as c++
+#ifndef DEPTH_KEY_LIGHT_IDX_BITS
+#define DEPTH_KEY_LIGHT_IDX_BITS 12
+#define DEPTH_KEY_MAX_LIGHTS (1u << DEPTH_KEY_LIGHT_IDX_BITS)
+#define DEPTH_KEY_LIGHT_IDX_MASK (DEPTH_KEY_MAX_LIGHTS - 1u)
+// skipped lights sort behind every depth
+#define SKIPPED_DEPTH_KEY (~DEPTH_KEY_LIGHT_IDX_MASK)
+#endif
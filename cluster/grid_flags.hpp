@@ -0,0 +1,89 @@
+#pragma once
+#include "Grid.hpp"
+#include <simd.hpp>
+#include <cstdint>
+
+// grid flags from a view space depth image, clustering.frag per pixel
+//
+// view_z holds the view space z of the visible surface per pixel, negative
+// in front of the camera; pixels without geometry hold 0 or more and are
+// ignored. every pixel of row y lies in tile row y / tile height, so rows of
+// different tile rows never write the same flag.
+
+namespace cluster
+{
+typedef void (*Flag_depth_row_fn)(const Grid &grid, const float *p_view_z, uint32_t y, uint32_t begin, uint32_t end, uint8_t *p_grid_flags);
+
+void flag_depth_row_scalar(const Grid &grid, const float *p_view_z, uint32_t y, uint32_t begin, uint32_t end, uint8_t *p_grid_flags)
+{
+    const float frag_y=static_cast<float>(y) + 0.5f;
+    for (uint32_t x=begin; x < end; x++) {
+        if (!(p_view_z[x] < 0.f)) continue;
+        glm::uvec3 c=frag_pos_to_grid_coord(grid, glm::vec2(static_cast<float>(x) + 0.5f, frag_y), p_view_z[x]);
+        p_grid_flags[grid_coord_to_grid_idx(grid, c.x, c.y, c.z)]=1;
+    }
+}
+
+// p_view_z is the start of row y, read unaligned
+BASE_TARGET_SSE41
+void flag_depth_row_sse41(const Grid &grid, const float *p_view_z, uint32_t y, uint32_t begin, uint32_t end, uint8_t *p_grid_flags)
+{
+    const uint32_t j=static_cast<uint32_t>((static_cast<float>(y) + 0.5f - 0.5f) / grid.tile_size.y);
+    const __m128i row_base=_mm_set1_epi32(static_cast<int>(grid.dim_x * j));
+    const __m128i slice_size=_mm_set1_epi32(static_cast<int>(grid.dim_x * grid.dim_y));
+    const __m128 half=_mm_set1_ps(0.5f);
+    const __m128 tile_x=_mm_set1_ps(grid.tile_size.x);
+    alignas(16) uint32_t idx[4];
+    uint32_t x=begin;
+    for (; x + 4 <= end; x+=4) {
+        __m128 view_z=_mm_loadu_ps(p_view_z + x);
+        const uint32_t valid=static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(view_z, _mm_setzero_ps())));
+        if (!valid) continue;
+        __m128 frag_x=_mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(static_cast<int>(x)), _mm_setr_epi32(0, 1, 2, 3))), half);
+        __m128i i=_mm_cvttps_epi32(_mm_div_ps(_mm_sub_ps(frag_x, half), tile_x));
+        __m128i k=_mm_cvttps_epi32(view_z_to_grid_z_sse41(grid, view_z));
+        __m128i cell=_mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(k, slice_size), row_base), i);
+        _mm_store_si128(reinterpret_cast<__m128i *>(idx), cell);
+        for (uint32_t l=0; l < 4; l++) {
+            if ((valid >> l) & 1) p_grid_flags[idx[l]]=1;
+        }
+    }
+    flag_depth_row_scalar(grid, p_view_z, y, x, end, p_grid_flags);
+}
+
+BASE_TARGET_AVX2_NO_FMA
+void flag_depth_row_avx2(const Grid &grid, const float *p_view_z, uint32_t y, uint32_t begin, uint32_t end, uint8_t *p_grid_flags)
+{
+    const uint32_t j=static_cast<uint32_t>((static_cast<float>(y) + 0.5f - 0.5f) / grid.tile_size.y);
+    const __m256i row_base=_mm256_set1_epi32(static_cast<int>(grid.dim_x * j));
+    const __m256i slice_size=_mm256_set1_epi32(static_cast<int>(grid.dim_x * grid.dim_y));
+    const __m256 half=_mm256_set1_ps(0.5f);
+    const __m256 tile_x=_mm256_set1_ps(grid.tile_size.x);
+    alignas(32) uint32_t idx[8];
+    uint32_t x=begin;
+    for (; x + 8 <= end; x+=8) {
+        __m256 view_z=_mm256_loadu_ps(p_view_z + x);
+        const uint32_t valid=static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(view_z, _mm256_setzero_ps(), _CMP_LT_OQ)));
+        if (!valid) continue;
+        __m256 frag_x=_mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(x)),
+                                                                        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))), half);
+        __m256i i=_mm256_cvttps_epi32(_mm256_div_ps(_mm256_sub_ps(frag_x, half), tile_x));
+        __m256i k=_mm256_cvttps_epi32(view_z_to_grid_z_avx2(grid, view_z));
+        __m256i cell=_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(k, slice_size), row_base), i);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(idx), cell);
+        for (uint32_t l=0; l < 8; l++) {
+            if ((valid >> l) & 1) p_grid_flags[idx[l]]=1;
+        }
+    }
+    flag_depth_row_scalar(grid, p_view_z, y, x, end, p_grid_flags);
+}
+
+Flag_depth_row_fn select_flag_depth_row_fn(base::Simd_level level)
+{
+    switch (level) {
+        case base::SIMD_AVX2:return flag_depth_row_avx2;
+        case base::SIMD_SSE41:return flag_depth_row_sse41;
+        default:return flag_depth_row_scalar;
+    }
+}
+} // namespace cluster
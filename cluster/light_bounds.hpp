@@ -0,0 +1,270 @@
+#pragma once
+#include "Grid.hpp"
+#include "sphere_bounds.hpp"
+#include <simd.hpp>
+#include <cstdint>
+
+// cluster bounds of light spheres, calc_light_grids.comp step by step
+//
+// light_bounds holds the packed min and max grid coord per light, the
+// rg32ui texels of demo/light_bounds.glsl. lights that miss the grid get
+// min x 1 and max x 0, the empty x range calc_light_list.comp tests for,
+// and zeros elsewhere.
+//
+// the light spheres come as vec4(position, range) per light, the
+// light_pos_ranges layout of the unpacked gpu format.
+
+namespace cluster
+{
+typedef void (*Calc_light_bounds_fn)(const Grid &grid,
+                                     const float *p_pos_ranges,
+                                     uint32_t begin,
+                                     uint32_t end,
+                                     uint32_t *p_light_bounds);
+
+// x in bits 0-9, y in 10-19 and z in 20-31 like light_bounds.glsl
+uint32_t pack_grid_coord(const glm::uvec3 &coord)
+{
+    return coord.x | (coord.y << 10) | (coord.z << 20);
+}
+
+glm::uvec3 unpack_grid_coord(uint32_t bits)
+{
+    return glm::uvec3(bits & 0x3ffu, (bits >> 10) & 0x3ffu, bits >> 20);
+}
+
+// min and max with the nan handling of minps and maxps
+float min_ps(float a, float b)
+{
+    return a < b ? a : b;
+}
+
+float max_ps(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+void calc_light_bounds_scalar(const Grid &grid, const float *p_pos_ranges, uint32_t begin, uint32_t end, uint32_t *p_light_bounds)
+{
+    const glm::mat4 &v=grid.view;
+    for (uint32_t i=begin; i < end; i++) {
+        const float *p=p_pos_ranges + i * 4;
+        uint32_t *p_out=p_light_bounds + i * 2;
+        const float r=p[3];
+
+        // view space pos
+        float vx=v[0][0] * p[0] + v[1][0] * p[1] + v[2][0] * p[2] + v[3][0];
+        float vy=v[0][1] * p[0] + v[1][1] * p[1] + v[2][1] * p[2] + v[3][1];
+        float vz=v[0][2] * p[0] + v[1][2] * p[1] + v[2][2] * p[2] + v[3][2];
+        float min_z=vz + r, max_z=vz - r;
+
+        // restrict view_z
+        bool skip=(max_z >= -grid.cam_near) || (min_z <= -grid.cam_far);
+        min_z=min_ps(min_z, -grid.cam_near);
+        max_z=max_ps(max_z, -grid.cam_far);
+
+        // frag pos, tangent bounds of the projected sphere
+        const float res_x=grid.resolution.x, res_y=grid.resolution.y;
+        glm::vec4 ndc=sphere_ndc_bounds(glm::vec3(vx, vy, vz), r, grid.cam_near, grid.projection_clip);
+        float fp_min_x=0.5f * (1.f + ndc.x) * res_x, fp_min_y=0.5f * (1.f + ndc.y) * res_y;
+        float fp_max_x=0.5f * (1.f + ndc.z) * res_x, fp_max_y=0.5f * (1.f + ndc.w) * res_y;
+
+        // restrict frag_pos to the frustum
+        skip=skip || (fp_min_x < 0.f && fp_max_x < 0.f) || (fp_min_y < 0.f && fp_max_y < 0.f);
+        skip=skip || (fp_min_x >= res_x && fp_max_x >= res_x) || (fp_min_y >= res_y && fp_max_y >= res_y);
+        skip=skip || fp_min_x > fp_max_x || fp_min_y > fp_max_y;
+        if (skip) {
+            p_out[0]=pack_grid_coord(glm::uvec3(1, 0, 0));
+            p_out[1]=0;
+            continue;
+        }
+        fp_min_x=max_ps(fp_min_x, 0.f);
+        fp_min_y=max_ps(fp_min_y, 0.f);
+        fp_max_x=min_ps(fp_max_x, res_x - 1.f);
+        fp_max_y=min_ps(fp_max_y, res_y - 1.f);
+
+        // grid coord
+        p_out[0]=pack_grid_coord(glm::uvec3(static_cast<uint32_t>(fp_min_x / grid.tile_size.x),
+                                            static_cast<uint32_t>(fp_min_y / grid.tile_size.y),
+                                            static_cast<uint32_t>(view_z_to_grid_z(grid, min_z))));
+        p_out[1]=pack_grid_coord(glm::uvec3(static_cast<uint32_t>(fp_max_x / grid.tile_size.x),
+                                            static_cast<uint32_t>(fp_max_y / grid.tile_size.y),
+                                            static_cast<uint32_t>(view_z_to_grid_z(grid, max_z))));
+    }
+}
+
+// packs the lanes of the six bound vectors into 2 uints per light
+template<uint32_t LANES>
+void store_light_bounds(const uint32_t bounds[6][LANES], uint32_t skip_mask, uint32_t *p_out)
+{
+    for (uint32_t k=0; k < LANES; k++, p_out+=2) {
+        if ((skip_mask >> k) & 1) {
+            p_out[0]=pack_grid_coord(glm::uvec3(1, 0, 0));
+            p_out[1]=0;
+        }
+        else {
+            p_out[0]=pack_grid_coord(glm::uvec3(bounds[0][k], bounds[1][k], bounds[2][k]));
+            p_out[1]=pack_grid_coord(glm::uvec3(bounds[3][k], bounds[4][k], bounds[5][k]));
+        }
+    }
+}
+
+// row r of a * vec4(x, y, z, 1)
+BASE_TARGET_SSE41
+__m128 mat_row_sse41(const glm::mat4 &a, int r, __m128 x, __m128 y, __m128 z)
+{
+    __m128 d=_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0][r]), x), _mm_mul_ps(_mm_set1_ps(a[1][r]), y));
+    d=_mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(a[2][r]), z));
+    return _mm_add_ps(d, _mm_set1_ps(a[3][r]));
+}
+
+// begin can be any light, the light_pos_ranges loads are unaligned
+BASE_TARGET_SSE41
+void calc_light_bounds_sse41(const Grid &grid, const float *p_pos_ranges, uint32_t begin, uint32_t end, uint32_t *p_light_bounds)
+{
+    const __m128 near_neg=_mm_set1_ps(-grid.cam_near), far_neg=_mm_set1_ps(-grid.cam_far);
+    const __m128 res_x=_mm_set1_ps(grid.resolution.x), res_y=_mm_set1_ps(grid.resolution.y);
+    const __m128 tile_x=_mm_set1_ps(grid.tile_size.x), tile_y=_mm_set1_ps(grid.tile_size.y);
+    const __m128 zero=_mm_setzero_ps(), one=_mm_set1_ps(1.f), half=_mm_set1_ps(0.5f);
+    uint32_t i=begin;
+    for (; i + 4 <= end; i+=4) {
+        // aos -> soa
+        __m128 x=_mm_loadu_ps(p_pos_ranges + i * 4 + 0);
+        __m128 y=_mm_loadu_ps(p_pos_ranges + i * 4 + 4);
+        __m128 z=_mm_loadu_ps(p_pos_ranges + i * 4 + 8);
+        __m128 r=_mm_loadu_ps(p_pos_ranges + i * 4 + 12);
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+
+        // view space pos
+        __m128 vx=mat_row_sse41(grid.view, 0, x, y, z);
+        __m128 vy=mat_row_sse41(grid.view, 1, x, y, z);
+        __m128 vz=mat_row_sse41(grid.view, 2, x, y, z);
+        __m128 min_z=_mm_add_ps(vz, r), max_z=_mm_sub_ps(vz, r);
+
+        // restrict view_z
+        __m128 skip=_mm_or_ps(_mm_cmpge_ps(max_z, near_neg), _mm_cmple_ps(min_z, far_neg));
+        min_z=_mm_min_ps(min_z, near_neg);
+        max_z=_mm_max_ps(max_z, far_neg);
+
+        // frag pos, tangent bounds of the projected sphere
+        __m128 fp_min_x, fp_min_y, fp_max_x, fp_max_y;
+        sphere_ndc_bounds_sse41(vx, vy, vz, r, grid.cam_near, grid.projection_clip, fp_min_x, fp_min_y, fp_max_x, fp_max_y);
+        fp_min_x=_mm_mul_ps(_mm_mul_ps(half, _mm_add_ps(one, fp_min_x)), res_x);
+        fp_min_y=_mm_mul_ps(_mm_mul_ps(half, _mm_add_ps(one, fp_min_y)), res_y);
+        fp_max_x=_mm_mul_ps(_mm_mul_ps(half, _mm_add_ps(one, fp_max_x)), res_x);
+        fp_max_y=_mm_mul_ps(_mm_mul_ps(half, _mm_add_ps(one, fp_max_y)), res_y);
+
+        // restrict frag_pos to the frustum
+        skip=_mm_or_ps(skip, _mm_and_ps(_mm_cmplt_ps(fp_min_x, zero), _mm_cmplt_ps(fp_max_x, zero)));
+        skip=_mm_or_ps(skip, _mm_and_ps(_mm_cmplt_ps(fp_min_y, zero), _mm_cmplt_ps(fp_max_y, zero)));
+        skip=_mm_or_ps(skip, _mm_and_ps(_mm_cmpge_ps(fp_min_x, res_x), _mm_cmpge_ps(fp_max_x, res_x)));
+        skip=_mm_or_ps(skip, _mm_and_ps(_mm_cmpge_ps(fp_min_y, res_y), _mm_cmpge_ps(fp_max_y, res_y)));
+        skip=_mm_or_ps(skip, _mm_or_ps(_mm_cmpgt_ps(fp_min_x, fp_max_x), _mm_cmpgt_ps(fp_min_y, fp_max_y)));
+        fp_min_x=_mm_max_ps(fp_min_x, zero);
+        fp_min_y=_mm_max_ps(fp_min_y, zero);
+        fp_max_x=_mm_min_ps(fp_max_x, _mm_sub_ps(res_x, one));
+        fp_max_y=_mm_min_ps(fp_max_y, _mm_sub_ps(res_y, one));
+
+        // grid coord
+        alignas(16) uint32_t bounds[6][4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(bounds[0]), _mm_cvttps_epi32(_mm_div_ps(fp_min_x, tile_x)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(bounds[1]), _mm_cvttps_epi32(_mm_div_ps(fp_min_y, tile_y)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(bounds[2]), _mm_cvttps_epi32(view_z_to_grid_z_sse41(grid, min_z)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(bounds[3]), _mm_cvttps_epi32(_mm_div_ps(fp_max_x, tile_x)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(bounds[4]), _mm_cvttps_epi32(_mm_div_ps(fp_max_y, tile_y)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(bounds[5]), _mm_cvttps_epi32(view_z_to_grid_z_sse41(grid, max_z)));
+        store_light_bounds<4>(bounds, static_cast<uint32_t>(_mm_movemask_ps(skip)), p_light_bounds + i * 2);
+    }
+    calc_light_bounds_scalar(grid, p_pos_ranges, i, end, p_light_bounds);
+}
+
+// row r of a * vec4(x, y, z, 1)
+BASE_TARGET_AVX2_NO_FMA
+__m256 mat_row_avx2(const glm::mat4 &a, int r, __m256 x, __m256 y, __m256 z)
+{
+    __m256 d=_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[0][r]), x), _mm256_mul_ps(_mm256_set1_ps(a[1][r]), y));
+    d=_mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(a[2][r]), z));
+    return _mm256_add_ps(d, _mm256_set1_ps(a[3][r]));
+}
+
+// begin can be any light, the light_pos_ranges loads are unaligned
+BASE_TARGET_AVX2_NO_FMA
+void calc_light_bounds_avx2(const Grid &grid, const float *p_pos_ranges, uint32_t begin, uint32_t end, uint32_t *p_light_bounds)
+{
+    const __m256 near_neg=_mm256_set1_ps(-grid.cam_near), far_neg=_mm256_set1_ps(-grid.cam_far);
+    const __m256 res_x=_mm256_set1_ps(grid.resolution.x), res_y=_mm256_set1_ps(grid.resolution.y);
+    const __m256 tile_x=_mm256_set1_ps(grid.tile_size.x), tile_y=_mm256_set1_ps(grid.tile_size.y);
+    const __m256 zero=_mm256_setzero_ps(), one=_mm256_set1_ps(1.f), half=_mm256_set1_ps(0.5f);
+    uint32_t i=begin;
+    for (; i + 8 <= end; i+=8) {
+        // aos -> soa, lights k and k + 4 share a register before the in-lane transpose
+        const float *p=p_pos_ranges + i * 4;
+        __m256 l01=_mm256_loadu_ps(p + 0);
+        __m256 l23=_mm256_loadu_ps(p + 8);
+        __m256 l45=_mm256_loadu_ps(p + 16);
+        __m256 l67=_mm256_loadu_ps(p + 24);
+        __m256 l04=_mm256_permute2f128_ps(l01, l45, 0x20);
+        __m256 l15=_mm256_permute2f128_ps(l01, l45, 0x31);
+        __m256 l26=_mm256_permute2f128_ps(l23, l67, 0x20);
+        __m256 l37=_mm256_permute2f128_ps(l23, l67, 0x31);
+        __m256 t0=_mm256_unpacklo_ps(l04, l15);
+        __m256 t1=_mm256_unpackhi_ps(l04, l15);
+        __m256 t2=_mm256_unpacklo_ps(l26, l37);
+        __m256 t3=_mm256_unpackhi_ps(l26, l37);
+        __m256 x=_mm256_shuffle_ps(t0, t2, 0x44);
+        __m256 y=_mm256_shuffle_ps(t0, t2, 0xee);
+        __m256 z=_mm256_shuffle_ps(t1, t3, 0x44);
+        __m256 r=_mm256_shuffle_ps(t1, t3, 0xee);
+
+        // view space pos
+        __m256 vx=mat_row_avx2(grid.view, 0, x, y, z);
+        __m256 vy=mat_row_avx2(grid.view, 1, x, y, z);
+        __m256 vz=mat_row_avx2(grid.view, 2, x, y, z);
+        __m256 min_z=_mm256_add_ps(vz, r), max_z=_mm256_sub_ps(vz, r);
+
+        // restrict view_z
+        __m256 skip=_mm256_or_ps(_mm256_cmp_ps(max_z, near_neg, _CMP_GE_OQ), _mm256_cmp_ps(min_z, far_neg, _CMP_LE_OQ));
+        min_z=_mm256_min_ps(min_z, near_neg);
+        max_z=_mm256_max_ps(max_z, far_neg);
+
+        // frag pos, tangent bounds of the projected sphere
+        __m256 fp_min_x, fp_min_y, fp_max_x, fp_max_y;
+        sphere_ndc_bounds_avx2(vx, vy, vz, r, grid.cam_near, grid.projection_clip, fp_min_x, fp_min_y, fp_max_x, fp_max_y);
+        fp_min_x=_mm256_mul_ps(_mm256_mul_ps(half, _mm256_add_ps(one, fp_min_x)), res_x);
+        fp_min_y=_mm256_mul_ps(_mm256_mul_ps(half, _mm256_add_ps(one, fp_min_y)), res_y);
+        fp_max_x=_mm256_mul_ps(_mm256_mul_ps(half, _mm256_add_ps(one, fp_max_x)), res_x);
+        fp_max_y=_mm256_mul_ps(_mm256_mul_ps(half, _mm256_add_ps(one, fp_max_y)), res_y);
+
+        // restrict frag_pos to the frustum
+        skip=_mm256_or_ps(skip, _mm256_and_ps(_mm256_cmp_ps(fp_min_x, zero, _CMP_LT_OQ), _mm256_cmp_ps(fp_max_x, zero, _CMP_LT_OQ)));
+        skip=_mm256_or_ps(skip, _mm256_and_ps(_mm256_cmp_ps(fp_min_y, zero, _CMP_LT_OQ), _mm256_cmp_ps(fp_max_y, zero, _CMP_LT_OQ)));
+        skip=_mm256_or_ps(skip, _mm256_and_ps(_mm256_cmp_ps(fp_min_x, res_x, _CMP_GE_OQ), _mm256_cmp_ps(fp_max_x, res_x, _CMP_GE_OQ)));
+        skip=_mm256_or_ps(skip, _mm256_and_ps(_mm256_cmp_ps(fp_min_y, res_y, _CMP_GE_OQ), _mm256_cmp_ps(fp_max_y, res_y, _CMP_GE_OQ)));
+        skip=_mm256_or_ps(skip, _mm256_or_ps(_mm256_cmp_ps(fp_min_x, fp_max_x, _CMP_GT_OQ), _mm256_cmp_ps(fp_min_y, fp_max_y, _CMP_GT_OQ)));
+        fp_min_x=_mm256_max_ps(fp_min_x, zero);
+        fp_min_y=_mm256_max_ps(fp_min_y, zero);
+        fp_max_x=_mm256_min_ps(fp_max_x, _mm256_sub_ps(res_x, one));
+        fp_max_y=_mm256_min_ps(fp_max_y, _mm256_sub_ps(res_y, one));
+
+        // grid coord
+        alignas(32) uint32_t bounds[6][8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(bounds[0]), _mm256_cvttps_epi32(_mm256_div_ps(fp_min_x, tile_x)));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(bounds[1]), _mm256_cvttps_epi32(_mm256_div_ps(fp_min_y, tile_y)));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(bounds[2]), _mm256_cvttps_epi32(view_z_to_grid_z_avx2(grid, min_z)));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(bounds[3]), _mm256_cvttps_epi32(_mm256_div_ps(fp_max_x, tile_x)));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(bounds[4]), _mm256_cvttps_epi32(_mm256_div_ps(fp_max_y, tile_y)));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(bounds[5]), _mm256_cvttps_epi32(view_z_to_grid_z_avx2(grid, max_z)));
+        store_light_bounds<8>(bounds, static_cast<uint32_t>(_mm256_movemask_ps(skip)), p_light_bounds + i * 2);
+    }
+    calc_light_bounds_scalar(grid, p_pos_ranges, i, end, p_light_bounds);
+}
+
+Calc_light_bounds_fn select_calc_light_bounds_fn(base::Simd_level level)
+{
+    switch (level) {
+        case base::SIMD_AVX2:return calc_light_bounds_avx2;
+        case base::SIMD_SSE41:return calc_light_bounds_sse41;
+        default:return calc_light_bounds_scalar;
+    }
+}
+} // namespace cluster
@@ -0,0 +1,134 @@
+#pragma once
+#include <simd.hpp>
+#include <cstdint>
+#include <cstring>
+
+// natural logarithm of positive normal floats (cephes logf)
+//
+// the scalar and simd paths run the same operations in the same order and
+// without fma, so a grid coordinate never differs between them. the avx2
+// kernels are built for BASE_TARGET_AVX2_NO_FMA, so the scalar code inlined
+// into them isn't contracted either.
+
+namespace cluster
+{
+#define CLUSTER_LOG_SQRTHF 0.707106781186547524f
+#define CLUSTER_LOG_P0 7.0376836292e-2f
+#define CLUSTER_LOG_P1 -1.1514610310e-1f
+#define CLUSTER_LOG_P2 1.1676998740e-1f
+#define CLUSTER_LOG_P3 -1.2420140846e-1f
+#define CLUSTER_LOG_P4 1.4249322787e-1f
+#define CLUSTER_LOG_P5 -1.6668057665e-1f
+#define CLUSTER_LOG_P6 2.0000714765e-1f
+#define CLUSTER_LOG_P7 -2.4999993993e-1f
+#define CLUSTER_LOG_P8 3.3333331174e-1f
+#define CLUSTER_LOG_Q1 -2.12194440e-4f
+#define CLUSTER_LOG_Q2 0.693359375f
+
+float log_scalar(float a)
+{
+    uint32_t bits;
+    memcpy(&bits, &a, sizeof(bits));
+    // a = m * 2^e with m in [0.5, 1)
+    float e=static_cast<float>(static_cast<int32_t>(bits >> 23) - 126);
+    bits=(bits & 0x807fffffu) | 0x3f000000u;
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+
+    // m in [sqrt(0.5), sqrt(2))
+    float x;
+    if (m < CLUSTER_LOG_SQRTHF) {
+        e=e - 1.f;
+        x=(m - 1.f) + m;
+    }
+    else {
+        x=m - 1.f;
+    }
+
+    float z=x * x;
+    float y=CLUSTER_LOG_P0;
+    y=y * x + CLUSTER_LOG_P1;
+    y=y * x + CLUSTER_LOG_P2;
+    y=y * x + CLUSTER_LOG_P3;
+    y=y * x + CLUSTER_LOG_P4;
+    y=y * x + CLUSTER_LOG_P5;
+    y=y * x + CLUSTER_LOG_P6;
+    y=y * x + CLUSTER_LOG_P7;
+    y=y * x + CLUSTER_LOG_P8;
+    y=y * x * z;
+    y=y + e * CLUSTER_LOG_Q1;
+    y=y - 0.5f * z;
+    return (x + y) + e * CLUSTER_LOG_Q2;
+}
+
+BASE_TARGET_SSE41
+__m128 log_sse41(__m128 a)
+{
+    __m128i bits=_mm_castps_si128(a);
+    __m128 e=_mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+    __m128 m=_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x807fffff)),
+                                           _mm_set1_epi32(0x3f000000)));
+
+    const __m128 one=_mm_set1_ps(1.f);
+    __m128 small=_mm_cmplt_ps(m, _mm_set1_ps(CLUSTER_LOG_SQRTHF));
+    e=_mm_sub_ps(e, _mm_and_ps(small, one));
+    __m128 x=_mm_add_ps(_mm_sub_ps(m, one), _mm_and_ps(small, m));
+
+    __m128 z=_mm_mul_ps(x, x);
+    __m128 y=_mm_set1_ps(CLUSTER_LOG_P0);
+    y=_mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(CLUSTER_LOG_P1));
+    y=_mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(CLUSTER_LOG_P2));
+    y=_mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(CLUSTER_LOG_P3));
+    y=_mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(CLUSTER_LOG_P4));
+    y=_mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(CLUSTER_LOG_P5));
+    y=_mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(CLUSTER_LOG_P6));
+    y=_mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(CLUSTER_LOG_P7));
+    y=_mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(CLUSTER_LOG_P8));
+    y=_mm_mul_ps(_mm_mul_ps(y, x), z);
+    y=_mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(CLUSTER_LOG_Q1)));
+    y=_mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+    return _mm_add_ps(_mm_add_ps(x, y), _mm_mul_ps(e, _mm_set1_ps(CLUSTER_LOG_Q2)));
+}
+
+BASE_TARGET_AVX2_NO_FMA
+__m256 log_avx2(__m256 a)
+{
+    __m256i bits=_mm256_castps_si256(a);
+    __m256 e=_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+    __m256 m=_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x807fffff)),
+                                                 _mm256_set1_epi32(0x3f000000)));
+
+    const __m256 one=_mm256_set1_ps(1.f);
+    __m256 small=_mm256_cmp_ps(m, _mm256_set1_ps(CLUSTER_LOG_SQRTHF), _CMP_LT_OQ);
+    e=_mm256_sub_ps(e, _mm256_and_ps(small, one));
+    __m256 x=_mm256_add_ps(_mm256_sub_ps(m, one), _mm256_and_ps(small, m));
+
+    __m256 z=_mm256_mul_ps(x, x);
+    __m256 y=_mm256_set1_ps(CLUSTER_LOG_P0);
+    y=_mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(CLUSTER_LOG_P1));
+    y=_mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(CLUSTER_LOG_P2));
+    y=_mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(CLUSTER_LOG_P3));
+    y=_mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(CLUSTER_LOG_P4));
+    y=_mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(CLUSTER_LOG_P5));
+    y=_mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(CLUSTER_LOG_P6));
+    y=_mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(CLUSTER_LOG_P7));
+    y=_mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(CLUSTER_LOG_P8));
+    y=_mm256_mul_ps(_mm256_mul_ps(y, x), z);
+    y=_mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(CLUSTER_LOG_Q1)));
+    y=_mm256_sub_ps(y, _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+    return _mm256_add_ps(_mm256_add_ps(x, y), _mm256_mul_ps(e, _mm256_set1_ps(CLUSTER_LOG_Q2)));
+}
+
+#undef CLUSTER_LOG_SQRTHF
+#undef CLUSTER_LOG_P0
+#undef CLUSTER_LOG_P1
+#undef CLUSTER_LOG_P2
+#undef CLUSTER_LOG_P3
+#undef CLUSTER_LOG_P4
+#undef CLUSTER_LOG_P5
+#undef CLUSTER_LOG_P6
+#undef CLUSTER_LOG_P7
+#undef CLUSTER_LOG_P8
+#undef CLUSTER_LOG_Q1
+#undef CLUSTER_LOG_Q2
+} // namespace cluster
@@ -0,0 +1,50 @@
+// screen bounds of a light sphere, shared by calc_light_grids.comp and the cpu
+// library (sphere_bounds.hpp). the code is glsl that also compiles as c++
+// with glm: no swizzles, no const locals, float literals with f
+//
+// 2d polyhedral bounds of a clipped, perspective-projected 3d sphere (mara,
+// mcguire 2013). per axis, the eye's tangent lines to the sphere's circle in
+// the (axis, z) plane bound the projection. where a tangent point lies in
+// front of the near plane, the circle's intersection with the near plane
+// bounds the visible part instead.
+
+// slope range, axis / -z, of the circle with center c = (axis, view z) and
+// radius r whose back lies behind the near plane at view z near_z
+vec2 sphere_axis_slopes(vec2 c, float r, float near_z)
+{
+    float c_sq = dot(c, c);
+    float t_sq = c_sq - r * r;
+    bool outside = t_sq > 0.f; // eye outside the circle
+    float c_len = sqrt(c_sq);
+    float cos_t = outside ? sqrt(t_sq) / c_len : 0.f;
+    float sin_t = outside ? r / c_len : 0.f;
+
+    // tangent points, c rotated by the tangent angle to either side and
+    // scaled to the tangent length
+    vec2 a = cos_t * vec2(cos_t * c.x - sin_t * c.y, sin_t * c.x + cos_t * c.y);
+    vec2 b = cos_t * vec2(cos_t * c.x + sin_t * c.y, cos_t * c.y - sin_t * c.x);
+
+    float d = near_z - c.y;
+    float near_half = sqrt(max(0.f, r * r - d * d));
+    if (!outside || a.y > near_z) a = vec2(c.x + near_half, near_z);
+    if (!outside || b.y > near_z) b = vec2(c.x - near_half, near_z);
+
+    float slope_a = a.x / -a.y;
+    float slope_b = b.x / -b.y;
+    return vec2(min(slope_a, slope_b), max(slope_a, slope_b));
+}
+
+// ndc rectangle (min x, min y, max x, max y) of the view space sphere with
+// center c and radius r that reaches behind the near plane at -cam_near.
+// ndc = scale * slope - offset for a perspective projection, the y scale is
+// negative with the vulkan clip matrix
+vec4 sphere_ndc_bounds(vec3 c, float r, float cam_near, mat4 projection)
+{
+    vec2 slopes_x = sphere_axis_slopes(vec2(c.x, c.z), r, -cam_near);
+    vec2 slopes_y = sphere_axis_slopes(vec2(c.y, c.z), r, -cam_near);
+    float x0 = projection[0][0] * slopes_x.x - projection[2][0];
+    float x1 = projection[0][0] * slopes_x.y - projection[2][0];
+    float y0 = projection[1][1] * slopes_y.x - projection[2][1];
+    float y1 = projection[1][1] * slopes_y.y - projection[2][1];
+    return vec4(min(x0, x1), min(y0, y1), max(x0, x1), max(y0, y1));
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <simd.hpp>
+#include <cmath>
+
+// screen bounds of light spheres, sphere_bounds.glsl for the cpu
+//
+// the glsl source is compiled as c++ in namespace glsl, where the builtins
+// it calls map to glm and cmath. min and max follow minps and maxps, so the
+// simd ports below, which run the same operations in the same order, give
+// the same bits as the scalar code.
+
+namespace cluster
+{
+namespace glsl
+{
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+using glm::dot;
+using std::sqrt;
+
+float min(float a, float b)
+{
+    return a < b ? a : b;
+}
+
+float max(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+#include "sphere_bounds.glsl"
+} // namespace glsl
+
+using glsl::sphere_axis_slopes;
+using glsl::sphere_ndc_bounds;
+
+BASE_TARGET_SSE41
+void sphere_axis_slopes_sse41(__m128 c_x, __m128 c_y, __m128 r, __m128 near_z, __m128 &lo, __m128 &hi)
+{
+    const __m128 zero=_mm_setzero_ps(), sign=_mm_set1_ps(-0.f);
+    __m128 c_sq=_mm_add_ps(_mm_mul_ps(c_x, c_x), _mm_mul_ps(c_y, c_y));
+    __m128 r_sq=_mm_mul_ps(r, r);
+    __m128 t_sq=_mm_sub_ps(c_sq, r_sq);
+    __m128 outside=_mm_cmpgt_ps(t_sq, zero);
+    __m128 c_len=_mm_sqrt_ps(c_sq);
+    __m128 cos_t=_mm_and_ps(outside, _mm_div_ps(_mm_sqrt_ps(t_sq), c_len));
+    __m128 sin_t=_mm_and_ps(outside, _mm_div_ps(r, c_len));
+
+    __m128 a_x=_mm_mul_ps(cos_t, _mm_sub_ps(_mm_mul_ps(cos_t, c_x), _mm_mul_ps(sin_t, c_y)));
+    __m128 a_y=_mm_mul_ps(cos_t, _mm_add_ps(_mm_mul_ps(sin_t, c_x), _mm_mul_ps(cos_t, c_y)));
+    __m128 b_x=_mm_mul_ps(cos_t, _mm_add_ps(_mm_mul_ps(cos_t, c_x), _mm_mul_ps(sin_t, c_y)));
+    __m128 b_y=_mm_mul_ps(cos_t, _mm_sub_ps(_mm_mul_ps(cos_t, c_y), _mm_mul_ps(sin_t, c_x)));
+
+    __m128 d=_mm_sub_ps(near_z, c_y);
+    __m128 near_half=_mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(r_sq, _mm_mul_ps(d, d))));
+    __m128 inside=_mm_cmpngt_ps(t_sq, zero);
+    __m128 near_a=_mm_or_ps(inside, _mm_cmpgt_ps(a_y, near_z));
+    __m128 near_b=_mm_or_ps(inside, _mm_cmpgt_ps(b_y, near_z));
+    a_x=_mm_blendv_ps(a_x, _mm_add_ps(c_x, near_half), near_a);
+    a_y=_mm_blendv_ps(a_y, near_z, near_a);
+    b_x=_mm_blendv_ps(b_x, _mm_sub_ps(c_x, near_half), near_b);
+    b_y=_mm_blendv_ps(b_y, near_z, near_b);
+
+    __m128 slope_a=_mm_div_ps(a_x, _mm_xor_ps(a_y, sign));
+    __m128 slope_b=_mm_div_ps(b_x, _mm_xor_ps(b_y, sign));
+    lo=_mm_min_ps(slope_a, slope_b);
+    hi=_mm_max_ps(slope_a, slope_b);
+}
+
+BASE_TARGET_SSE41
+void sphere_ndc_bounds_sse41(__m128 c_x, __m128 c_y, __m128 c_z, __m128 r, float cam_near, const glm::mat4 &projection,
+                             __m128 &min_x, __m128 &min_y, __m128 &max_x, __m128 &max_y)
+{
+    const __m128 near_z=_mm_set1_ps(-cam_near);
+    __m128 lo, hi;
+    sphere_axis_slopes_sse41(c_x, c_z, r, near_z, lo, hi);
+    __m128 x0=_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(projection[0][0]), lo), _mm_set1_ps(projection[2][0]));
+    __m128 x1=_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(projection[0][0]), hi), _mm_set1_ps(projection[2][0]));
+    sphere_axis_slopes_sse41(c_y, c_z, r, near_z, lo, hi);
+    __m128 y0=_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(projection[1][1]), lo), _mm_set1_ps(projection[2][1]));
+    __m128 y1=_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(projection[1][1]), hi), _mm_set1_ps(projection[2][1]));
+    min_x=_mm_min_ps(x0, x1);
+    min_y=_mm_min_ps(y0, y1);
+    max_x=_mm_max_ps(x0, x1);
+    max_y=_mm_max_ps(y0, y1);
+}
+
+BASE_TARGET_AVX2_NO_FMA
+void sphere_axis_slopes_avx2(__m256 c_x, __m256 c_y, __m256 r, __m256 near_z, __m256 &lo, __m256 &hi)
+{
+    const __m256 zero=_mm256_setzero_ps(), sign=_mm256_set1_ps(-0.f);
+    __m256 c_sq=_mm256_add_ps(_mm256_mul_ps(c_x, c_x), _mm256_mul_ps(c_y, c_y));
+    __m256 r_sq=_mm256_mul_ps(r, r);
+    __m256 t_sq=_mm256_sub_ps(c_sq, r_sq);
+    __m256 outside=_mm256_cmp_ps(t_sq, zero, _CMP_GT_OQ);
+    __m256 c_len=_mm256_sqrt_ps(c_sq);
+    __m256 cos_t=_mm256_and_ps(outside, _mm256_div_ps(_mm256_sqrt_ps(t_sq), c_len));
+    __m256 sin_t=_mm256_and_ps(outside, _mm256_div_ps(r, c_len));
+
+    __m256 a_x=_mm256_mul_ps(cos_t, _mm256_sub_ps(_mm256_mul_ps(cos_t, c_x), _mm256_mul_ps(sin_t, c_y)));
+    __m256 a_y=_mm256_mul_ps(cos_t, _mm256_add_ps(_mm256_mul_ps(sin_t, c_x), _mm256_mul_ps(cos_t, c_y)));
+    __m256 b_x=_mm256_mul_ps(cos_t, _mm256_add_ps(_mm256_mul_ps(cos_t, c_x), _mm256_mul_ps(sin_t, c_y)));
+    __m256 b_y=_mm256_mul_ps(cos_t, _mm256_sub_ps(_mm256_mul_ps(cos_t, c_y), _mm256_mul_ps(sin_t, c_x)));
+
+    __m256 d=_mm256_sub_ps(near_z, c_y);
+    __m256 near_half=_mm256_sqrt_ps(_mm256_max_ps(zero, _mm256_sub_ps(r_sq, _mm256_mul_ps(d, d))));
+    __m256 inside=_mm256_cmp_ps(t_sq, zero, _CMP_NGT_UQ);
+    __m256 near_a=_mm256_or_ps(inside, _mm256_cmp_ps(a_y, near_z, _CMP_GT_OQ));
+    __m256 near_b=_mm256_or_ps(inside, _mm256_cmp_ps(b_y, near_z, _CMP_GT_OQ));
+    a_x=_mm256_blendv_ps(a_x, _mm256_add_ps(c_x, near_half), near_a);
+    a_y=_mm256_blendv_ps(a_y, near_z, near_a);
+    b_x=_mm256_blendv_ps(b_x, _mm256_sub_ps(c_x, near_half), near_b);
+    b_y=_mm256_blendv_ps(b_y, near_z, near_b);
+
+    __m256 slope_a=_mm256_div_ps(a_x, _mm256_xor_ps(a_y, sign));
+    __m256 slope_b=_mm256_div_ps(b_x, _mm256_xor_ps(b_y, sign));
+    lo=_mm256_min_ps(slope_a, slope_b);
+    hi=_mm256_max_ps(slope_a, slope_b);
+}
+
+BASE_TARGET_AVX2_NO_FMA
+void sphere_ndc_bounds_avx2(__m256 c_x, __m256 c_y, __m256 c_z, __m256 r, float cam_near, const glm::mat4 &projection,
+                            __m256 &min_x, __m256 &min_y, __m256 &max_x, __m256 &max_y)
+{
+    const __m256 near_z=_mm256_set1_ps(-cam_near);
+    __m256 lo, hi;
+    sphere_axis_slopes_avx2(c_x, c_z, r, near_z, lo, hi);
+    __m256 x0=_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(projection[0][0]), lo), _mm256_set1_ps(projection[2][0]));
+    __m256 x1=_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(projection[0][0]), hi), _mm256_set1_ps(projection[2][0]));
+    sphere_axis_slopes_avx2(c_y, c_z, r, near_z, lo, hi);
+    __m256 y0=_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(projection[1][1]), lo), _mm256_set1_ps(projection[2][1]));
+    __m256 y1=_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(projection[1][1]), hi), _mm256_set1_ps(projection[2][1]));
+    min_x=_mm256_min_ps(x0, x1);
+    min_y=_mm256_min_ps(y0, y1);
+    max_x=_mm256_max_ps(x0, x1);
+    max_y=_mm256_max_ps(y0, y1);
+}
+} // namespace cluster
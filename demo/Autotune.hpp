@@ -0,0 +1,197 @@
+#pragma once
+#include <Camera.hpp>
+#include "Prog_info.hpp"
+#include "Frame_tuner.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// square tile sizes and z slice counts replayed over the recorded camera
+// path, or the current view without one. a configuration is timed after
+// AUTOTUNE_WARMUP_FRAMES over the path, at least AUTOTUNE_MIN_FRAMES
+// frames, and the lowest total GPU time is kept. with a camera path file
+// the path is loaded at startup and saved when a recording stops
+class Autotune : public Frame_tuner
+{
+public:
+    // max_grid_count: clusters the grid buffers hold
+    Autotune(Prog_info *p_info, base::Camera *p_camera, const vk::PhysicalDeviceLimits &limits, uint32_t max_grid_count)
+        :p_info_(p_info),
+        p_camera_(p_camera),
+        max_group_size_(std::min(limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations)),
+        max_grid_count_(max_grid_count)
+    {
+        if (!p_info_->camera_path_file.empty()) load_camera_path_(p_info_->camera_path_file.c_str());
+    }
+
+    bool active() const override
+    {
+        return p_info_->autotune;
+    }
+
+    // called every frame, a new recording starts a new path
+    void record_camera_path()
+    {
+        if (p_info_->record_camera_path) {
+            if (!camera_path_recording_) camera_path_.clear();
+            camera_path_.push_back({p_camera_->eye_pos, p_camera_->target});
+        }
+        else if (camera_path_recording_ && !p_info_->camera_path_file.empty()) {
+            save_camera_path_(p_info_->camera_path_file.c_str());
+        }
+        camera_path_recording_=p_info_->record_camera_path;
+    }
+
+    // pose count and state for the text overlay
+    std::string camera_path_str() const
+    {
+        std::stringstream ss;
+        ss << camera_path_.size() << " poses";
+        if (p_info_->record_camera_path) ss << ", recording";
+        else if (p_info_->autotune && !configs_.empty()) ss << ", autotune " << config_idx_ + 1 << " / " << configs_.size();
+        return ss.str();
+    }
+
+    bool update(const Pass_times &times) override
+    {
+        if (configs_.empty()) {
+            init_configs_();
+            total_ms_.assign(configs_.size(), 0.f);
+            pose_={p_camera_->eye_pos, p_camera_->target};
+            if (camera_path_.empty()) camera_path_.push_back(pose_);
+            printf("grid autotune, %ux%u, %u lights, %s, %zu camera poses, GPU ms per frame\n",
+                   p_info_->width(), p_info_->height(), p_info_->num_lights,
+                   light_assignment_str(p_info_->light_assignment), camera_path_.size());
+            printf("%6s  %6s  %8s\n", "tile", "slices", "GPU ms");
+            config_idx_=0;
+            start_run_();
+            return true;
+        }
+
+        const uint32_t frame_count=std::max(AUTOTUNE_MIN_FRAMES, static_cast<uint32_t>(camera_path_.size()));
+        if (++frame_ > AUTOTUNE_WARMUP_FRAMES) {
+            gpu_ns_+=times.depth_pass + times.clustering + times.animate_lights + times.calc_light_grids +
+                times.calc_grid_offsets + times.calc_light_list + times.onscreen + times.transfer;
+        }
+        if (frame_ < AUTOTUNE_WARMUP_FRAMES + frame_count) {
+            set_camera_pose_(camera_path_[frame_ % camera_path_.size()]);
+            return false;
+        }
+
+        const Grid_config &config=configs_[config_idx_];
+        total_ms_[config_idx_]=static_cast<float>(gpu_ns_) / (frame_count * 1000000.f);
+        printf("%6u  %6u  %8.3f\n", config.tile_size, config.tile_count_z, total_ms_[config_idx_]);
+        if (++config_idx_ < configs_.size()) {
+            start_run_();
+            return true;
+        }
+
+        const size_t best=std::min_element(total_ms_.begin(), total_ms_.end()) - total_ms_.begin();
+        printf("fastest: %ux%u px tiles, %u z slices\n", configs_[best].tile_size, configs_[best].tile_size, configs_[best].tile_count_z);
+        fflush(stdout);
+        apply_grid_config_(configs_[best]);
+        set_camera_pose_(pose_);
+        configs_.clear();
+        p_info_->autotune=false;
+        return true;
+    }
+
+private:
+    static constexpr uint32_t AUTOTUNE_WARMUP_FRAMES=10;
+    static constexpr uint32_t AUTOTUNE_MIN_FRAMES=60;
+
+    struct Grid_config
+    {
+        uint32_t tile_size;
+        uint32_t tile_count_z;
+    };
+
+    struct Camera_pose
+    {
+        glm::vec3 eye_pos;
+        glm::vec3 target;
+    };
+
+    Prog_info *p_info_;
+    base::Camera *p_camera_;
+    uint32_t max_group_size_; // calc_cluster_lights.comp runs an invocation per z slice
+    uint32_t max_grid_count_;
+    std::vector<Camera_pose> camera_path_;
+    bool camera_path_recording_{false}; // of the last frame
+    std::vector<Grid_config> configs_; // empty before the first run
+    size_t config_idx_{0};
+    uint32_t frame_{0};
+    uint64_t gpu_ns_{0};
+    std::vector<float> total_ms_;
+    Camera_pose pose_; // restored at the end
+
+    // the configurations that fit the grid buffers at the max resolution
+    void init_configs_()
+    {
+        static const uint32_t tile_sizes[]={32, 48, 64, 96, 128};
+        static const uint32_t tile_counts_z[]={64, 128, 256, 512};
+        for (uint32_t tile_size : tile_sizes) {
+            for (uint32_t tile_count_z : tile_counts_z) {
+                const uint32_t grid_count=((p_info_->MAX_WIDTH - 1) / tile_size + 1) *
+                    ((p_info_->MAX_HEIGHT - 1) / tile_size + 1) * tile_count_z;
+                if (tile_size < p_info_->MIN_TILE_SIZE || tile_count_z > p_info_->MAX_TILE_COUNT_Z ||
+                    tile_count_z > max_group_size_ || grid_count > max_grid_count_) continue;
+                configs_.push_back({tile_size, tile_count_z});
+            }
+        }
+    }
+
+    void start_run_()
+    {
+        apply_grid_config_(configs_[config_idx_]);
+        set_camera_pose_(camera_path_[0]);
+        frame_=0;
+        gpu_ns_=0;
+    }
+
+    // one pose per line: eye position, then target
+    void load_camera_path_(const char *p_path)
+    {
+        FILE *p_file=fopen(p_path, "r");
+        if (!p_file) return;
+
+        char line[256];
+        while (fgets(line, sizeof(line), p_file)) {
+            Camera_pose pose;
+            if (sscanf(line, "%f %f %f %f %f %f", &pose.eye_pos.x, &pose.eye_pos.y, &pose.eye_pos.z,
+                       &pose.target.x, &pose.target.y, &pose.target.z) == 6) camera_path_.push_back(pose);
+        }
+        fclose(p_file);
+        printf("%zu camera poses loaded from %s\n", camera_path_.size(), p_path);
+    }
+
+    void save_camera_path_(const char *p_path) const
+    {
+        FILE *p_file=fopen(p_path, "w");
+        if (!p_file) return;
+        for (const auto &pose : camera_path_) {
+            fprintf(p_file, "%.9g %.9g %.9g %.9g %.9g %.9g\n", pose.eye_pos.x, pose.eye_pos.y, pose.eye_pos.z,
+                    pose.target.x, pose.target.y, pose.target.z);
+        }
+        fclose(p_file);
+        printf("%zu camera poses saved to %s\n", camera_path_.size(), p_path);
+        fflush(stdout);
+    }
+
+    void set_camera_pose_(const Camera_pose &pose)
+    {
+        p_camera_->eye_pos=pose.eye_pos;
+        p_camera_->target=pose.target;
+        p_camera_->update();
+    }
+
+    void apply_grid_config_(const Grid_config &config)
+    {
+        p_info_->TILE_WIDTH=config.tile_size;
+        p_info_->TILE_HEIGHT=config.tile_size;
+        p_info_->TILE_COUNT_Z=config.tile_count_z;
+        p_info_->update_tile_counts();
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <Shell_base.hpp>
+#include "Prog_info.hpp"
+#include "Frame_tuner.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+// every light assignment at light counts from BENCHMARK_MIN_LIGHTS to
+// MAX_Z_BIN_LIGHTS, each timed over BENCHMARK_FRAMES after a warm up. the
+// masks run the list above MAX_MASK_LIGHTS. the assignment time is calc
+// light grids, grid offsets, light list and the buffer clears, the shading
+// time the onscreen pass. quits when done
+class Benchmark : public Frame_tuner
+{
+public:
+    Benchmark(Prog_info *p_info, base::Shell_base *p_shell)
+        :p_info_(p_info),
+        p_shell_(p_shell)
+    {}
+
+    bool active() const override
+    {
+        return p_info_->benchmark;
+    }
+
+    bool update(const Pass_times &times) override
+    {
+        if (num_lights_ == 0) {
+            printf("light assignment benchmark, %ux%u, GPU ms per frame (assignment + shading)\n",
+                   p_info_->width(), p_info_->height());
+            printf("%8s", "lights");
+            for (uint32_t i=0; i < LIGHT_ASSIGNMENT_COUNT; i++) printf("  %26s", light_assignment_str(static_cast<Light_assignment>(i)));
+            printf("\n");
+            num_lights_=BENCHMARK_MIN_LIGHTS;
+            start_run_();
+            return false;
+        }
+
+        if (++frame_ <= BENCHMARK_WARMUP_FRAMES) return false;
+        assign_ns_+=times.calc_light_grids + times.calc_grid_offsets + times.calc_light_list + times.transfer;
+        shade_ns_+=times.onscreen;
+        if (frame_ < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES) return false;
+
+        const float assign_ms=static_cast<float>(assign_ns_) / (BENCHMARK_FRAMES * 1000000.f);
+        const float shade_ms=static_cast<float>(shade_ns_) / (BENCHMARK_FRAMES * 1000000.f);
+        total_ms_[assignment_]=assign_ms + shade_ms;
+        if (assignment_ == LIGHT_ASSIGNMENT_LIST) printf("%8u", num_lights_);
+        printf("  %8.3f (%6.3f + %6.3f)", total_ms_[assignment_], assign_ms, shade_ms);
+        if (assignment_ + 1 < LIGHT_ASSIGNMENT_COUNT) {
+            assignment_=static_cast<Light_assignment>(assignment_ + 1);
+            start_run_();
+            return false;
+        }
+        printf("\n");
+        fastest_.emplace_back(num_lights_, static_cast<Light_assignment>(
+                                  std::min_element(total_ms_, total_ms_ + LIGHT_ASSIGNMENT_COUNT) - total_ms_));
+
+        assignment_=LIGHT_ASSIGNMENT_LIST;
+        num_lights_*=2;
+        if (num_lights_ <= std::max(p_info_->MAX_MASK_LIGHTS, p_info_->MAX_Z_BIN_LIGHTS)) {
+            start_run_();
+            return false;
+        }
+
+        // light count ranges of the fastest assignment
+        printf("fastest:\n");
+        for (size_t i=0; i < fastest_.size();) {
+            size_t j=i;
+            while (j + 1 < fastest_.size() && fastest_[j + 1].second == fastest_[i].second) j++;
+            printf("  %u - %u lights: %s\n", fastest_[i].first, fastest_[j].first, light_assignment_str(fastest_[i].second));
+            i=j + 1;
+        }
+        fflush(stdout);
+        p_info_->benchmark=false;
+        p_shell_->post_quit_msg();
+        return false;
+    }
+
+private:
+    static constexpr uint32_t BENCHMARK_MIN_LIGHTS=128;
+    static constexpr uint32_t BENCHMARK_WARMUP_FRAMES=30;
+    static constexpr uint32_t BENCHMARK_FRAMES=100;
+
+    Prog_info *p_info_;
+    base::Shell_base *p_shell_;
+    uint32_t num_lights_{0}; // 0 before the first run
+    Light_assignment assignment_{LIGHT_ASSIGNMENT_LIST};
+    uint32_t frame_{0};
+    uint64_t assign_ns_{0};
+    uint64_t shade_ns_{0};
+    float total_ms_[LIGHT_ASSIGNMENT_COUNT];
+    std::vector<std::pair<uint32_t, Light_assignment>> fastest_; // per light count
+
+    void start_run_()
+    {
+        p_info_->num_lights=num_lights_;
+        p_info_->light_assignment=assignment_;
+        p_info_->gen_lights=true;
+        frame_=0;
+        assign_ns_=0;
+        shade_ns_=0;
+    }
+};
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+// GPU ns of the timed passes of a frame
+struct Pass_times
+{
+    uint32_t depth_pass;
+    uint32_t clustering;
+    uint32_t animate_lights;
+    uint32_t calc_light_grids;
+    uint32_t calc_grid_offsets;
+    uint32_t calc_light_list;
+    uint32_t onscreen;
+    uint32_t transfer;
+};
+
+// a state machine over frames that changes the configuration in Prog_info
+// and times it. Program::on_frame_ updates the first active one with the
+// pass times of every frame
+class Frame_tuner
+{
+public:
+    virtual ~Frame_tuner() {}
+
+    virtual bool active() const=0;
+
+    // true when the grid configuration or the local sizes changed, the
+    // pipelines are rebuilt before the next frame
+    virtual bool update(const Pass_times &times)=0;
+};
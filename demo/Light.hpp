@@ -1,36 +1,560 @@
 #pragma once
+#include <glm/glm.hpp>
+#include <Aligned_array.hpp>
 #include <math.hpp>
+#include <Thread_pool.hpp>
+#include <radix_sort.hpp>
+#include "light_animation.hpp"
+#include "light_culling.hpp"
+#include <cstring>
+#include <cassert>
 #include <vector>
+#include <algorithm>
+#include <xmmintrin.h>
 
-class Light
+// one bit per block of lights
+class Block_bits
 {
 public:
-    glm::vec3 position;
-    glm::u8vec4 color;
-    float range;
-    glm::vec3 center{0.f};
-    base::Spherical s;
-
-    Light(const glm::vec3& position, glm::u8vec4 &color, float range)
-        :position(position),
-        color(color),
-        range(range)
-    {}
-
-    Light(const glm::vec3& position, const Light& light)
-        :position(position),
-        color(light.color),
-        range(light.range)
-    {}
-    void update(float elapsed_time)
-    {
-        s.set_from_vec(position - center);
-        s.el.z+=0.001;
-        s.restrict();
-        auto v=s.get_vec();
-        position=center + v;
+    void resize(uint32_t block_count)
+    {
+        bits_.assign((block_count + 63) / 64, 0);
+    }
+
+    void set(uint32_t block)
+    {
+        bits_[block / 64]|=1ull << (block % 64);
+    }
+
+    void reset(uint32_t block)
+    {
+        bits_[block / 64]&=~(1ull << (block % 64));
+    }
+
+    void set_range(uint32_t begin_block, uint32_t end_block)
+    {
+        for (uint32_t b=begin_block; b < end_block; b++) set(b);
+    }
+
+    void set_all()
+    {
+        for (auto &w : bits_) w=~0ull;
+    }
+
+    bool test(uint32_t block) const
+    {
+        return (bits_[block / 64] >> (block % 64)) & 1;
+    }
+
+    void merge(const Block_bits &other)
+    {
+        for (size_t i=0; i < bits_.size(); i++) bits_[i]|=other.bits_[i];
+    }
+
+    void clear()
+    {
+        for (auto &w : bits_) w=0;
+    }
+
+    // calls fn(begin_block, end_block) for every run of set bits below
+    // block_count
+    template<typename Fn>
+    void for_each_run(uint32_t block_count, Fn fn) const
+    {
+        uint32_t b=0;
+        while (b < block_count) {
+            uint64_t w=bits_[b / 64] >> (b % 64);
+            if (!w) {
+                b=(b / 64 + 1) * 64;
+                continue;
+            }
+            b+=ctz_(w);
+            if (b >= block_count) break;
+            uint32_t end=b + 1;
+            while (end < block_count && test(end)) end++;
+            fn(b, end);
+            b=end;
+        }
+    }
+
+private:
+    std::vector<uint64_t> bits_;
+
+    static uint32_t ctz_(uint64_t w)
+    {
+        uint32_t n=0;
+        while (!(w & 1)) {
+            w>>=1;
+            n++;
+        }
+        return n;
     }
 };
 
-typedef std::vector<Light> Lights;
+// structure-of-arrays light store
+// every stream is 64-byte aligned and sized for the max light count.
+// changes are tracked per block of BLOCK_SIZE lights so that only the
+// touched parts of the gpu buffers need to be rewritten
+class Lights
+{
+public:
+    // 256 lights * vec4 = one 4 KB page of pos_ranges
+    static const uint32_t BLOCK_SIZE=256;
+
+    // evaluated positions, written by update
+    base::Aligned_array<float> pos_x;
+    base::Aligned_array<float> pos_y;
+    base::Aligned_array<float> pos_z;
+    base::Aligned_array<float> pos_ranges; // vec4(position, range), gpu layout
+    base::Aligned_array<uint32_t> packed_pos_ranges; // 2 uints per light, see set_packing
+    base::Aligned_array<float> range;
+    base::Aligned_array<uint32_t> color; // rgba8 unorm
+    base::Aligned_array<uint32_t> id; // generation index, stays with the light when reordered
+
+    // orbit parameters, fixed at generation
+    base::Aligned_array<float> center_x;
+    base::Aligned_array<float> center_y;
+    base::Aligned_array<float> center_z;
+    base::Aligned_array<float> radius;
+    base::Aligned_array<float> elevation; // height of the orbit above the center
+    base::Aligned_array<float> angular_velocity; // rad per second
+    base::Aligned_array<float> phase;
+
+    explicit Lights(uint32_t capacity)
+        :pos_x(capacity),
+        pos_y(capacity),
+        pos_z(capacity),
+        pos_ranges(capacity * 4),
+        range(capacity),
+        color(capacity),
+        id(capacity),
+        center_x(capacity),
+        center_y(capacity),
+        center_z(capacity),
+        radius(capacity),
+        elevation(capacity),
+        angular_velocity(capacity),
+        phase(capacity),
+        capacity_(capacity)
+    {
+        set_simd_level(base::detect_simd_level());
+        moving_.resize(block_count(capacity));
+        pos_dirty_.resize(block_count(capacity));
+        color_dirty_.resize(block_count(capacity));
+    }
+
+    // packed gpu layout, 8 bytes per light: 16 bit unorm position inside
+    // [bounds_min, bounds_min + bounds_extent] and a half float range.
+    // the range is padded by the quantization error so that the decoded
+    // sphere contains the original one
+    // the bounds are also the domain of the morton codes in sort_by_position
+    void set_packing(bool packed, const glm::vec3 &bounds_min, const glm::vec3 &bounds_extent)
+    {
+        packed_=packed;
+        bounds_min_=bounds_min;
+        bounds_extent_=bounds_extent;
+        if (packed_ && !packed_pos_ranges.capacity()) packed_pos_ranges.allocate(capacity_ * 2);
+        mark_all_dirty();
+    }
+
+    bool packed() const
+    {
+        return packed_;
+    }
+
+    // distance between the decoded and the original position
+    float packing_error() const
+    {
+        return 0.5f * glm::length(bounds_extent_ / 65535.f);
+    }
+
+    // bytes per light in the gpu layout
+    uint32_t pos_range_size() const
+    {
+        return packed_ ? 2 * sizeof(uint32_t) : 4 * sizeof(float);
+    }
+
+    static uint32_t block_count(uint32_t light_count)
+    {
+        return (light_count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
 
+    uint32_t size() const
+    {
+        return size_;
+    }
+
+    uint32_t capacity() const
+    {
+        return capacity_;
+    }
+
+    base::Simd_level simd_level() const
+    {
+        return simd_level_;
+    }
+
+    void set_simd_level(base::Simd_level level)
+    {
+        simd_level_=level;
+        animate_fn_=select_animate_lights_fn(level);
+        cull_fn_=select_cull_lights_fn(level);
+    }
+
+    void clear()
+    {
+        size_=0;
+        moving_.clear();
+    }
+
+    // grow or shrink without touching the streams, new lights must be set
+    void resize(uint32_t size)
+    {
+        assert(size <= capacity_);
+        size_=size;
+    }
+
+    void add(const glm::vec3 &center,
+             float orbit_radius,
+             float orbit_elevation,
+             float orbit_angular_velocity,
+             float orbit_phase,
+             const glm::u8vec4 &col,
+             float r)
+    {
+        assert(size_ < capacity_);
+        set(size_++, center, orbit_radius, orbit_elevation, orbit_angular_velocity, orbit_phase, col, r);
+        mark_changed(size_ - 1, size_);
+    }
+
+    // lights are independent, so disjoint indices can be set from several
+    // threads. mark_changed must follow. lights are always set at their
+    // generation index, sorting only permutes the kept ones
+    void set(uint32_t i,
+             const glm::vec3 &center,
+             float orbit_radius,
+             float orbit_elevation,
+             float orbit_angular_velocity,
+             float orbit_phase,
+             const glm::u8vec4 &col,
+             float r)
+    {
+        assert(i < size_);
+        center_x[i]=center.x;
+        center_y[i]=center.y;
+        center_z[i]=center.z;
+        radius[i]=orbit_radius;
+        elevation[i]=orbit_elevation;
+        angular_velocity[i]=orbit_angular_velocity;
+        phase[i]=orbit_phase;
+        range[i]=r;
+        memcpy(&color[i], &col[0], sizeof(uint32_t));
+        id[i]=i;
+    }
+
+    // drop every light generated at index count or later, the kept lights
+    // are compacted in order. returns the first slot that changed
+    uint32_t truncate(uint32_t count)
+    {
+        assert(count <= size_);
+        uint32_t first_changed=count;
+        uint32_t w=0;
+        for (uint32_t i=0; i < size_; i++) {
+            if (id[i] >= count) continue;
+            if (w != i) {
+                move_light_(w, i);
+                first_changed=std::min(first_changed, w);
+            }
+            w++;
+        }
+        size_=count;
+        mark_changed(first_changed, size_);
+        return first_changed;
+    }
+
+    // reorder the lights along a 3d morton curve of their current position so
+    // that lights close in space are close in the gpu buffers
+    void sort_by_position(base::Thread_pool &pool)
+    {
+        if (size_ < 2) return;
+        sort_keys_.resize(capacity_);
+        sort_order_.resize(capacity_);
+        sort_tmp_keys_.resize(capacity_);
+        sort_tmp_order_.resize(capacity_);
+        permute_tmp_.resize(capacity_ * 2); // 16 bytes per light
+
+        const glm::vec3 scale=1023.f / bounds_extent_;
+        pool.parallel_for(size_, 16384, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i=begin; i < end; i++) {
+                uint32_t q[3];
+                const float p[3]={pos_x[i], pos_y[i], pos_z[i]};
+                for (int k=0; k < 3; k++) {
+                    float n=(p[k] - bounds_min_[k]) * scale[k];
+                    q[k]=static_cast<uint32_t>(std::min(1023.f, std::max(0.f, n)));
+                }
+                sort_keys_[i]=spread_bits_(q[0]) | (spread_bits_(q[1]) << 1) | (spread_bits_(q[2]) << 2);
+                sort_order_[i]=i;
+            }
+        });
+        base::parallel_radix_sort(pool,
+                                  sort_keys_.data(), sort_order_.data(),
+                                  sort_tmp_keys_.data(), sort_tmp_order_.data(),
+                                  size_, 30);
+
+        const uint32_t *p_order=sort_order_.data();
+        permute_(pool, pos_x.data(), 1, p_order);
+        permute_(pool, pos_y.data(), 1, p_order);
+        permute_(pool, pos_z.data(), 1, p_order);
+        permute_(pool, pos_ranges.data(), 4, p_order);
+        if (packed_) permute_(pool, packed_pos_ranges.data(), 2, p_order);
+        permute_(pool, range.data(), 1, p_order);
+        permute_(pool, color.data(), 1, p_order);
+        permute_(pool, id.data(), 1, p_order);
+        permute_(pool, center_x.data(), 1, p_order);
+        permute_(pool, center_y.data(), 1, p_order);
+        permute_(pool, center_z.data(), 1, p_order);
+        permute_(pool, radius.data(), 1, p_order);
+        permute_(pool, elevation.data(), 1, p_order);
+        permute_(pool, angular_velocity.data(), 1, p_order);
+        permute_(pool, phase.data(), 1, p_order);
+        mark_changed(0, size_);
+    }
+
+    // to be called once lights [begin, end) are set, not thread-safe since
+    // neighbouring blocks share bit words
+    void mark_changed(uint32_t begin, uint32_t end)
+    {
+        if (begin >= end) return;
+        for (uint32_t b=begin / BLOCK_SIZE; b < block_count(end); b++) {
+            pos_dirty_.set(b);
+            color_dirty_.set(b);
+            moving_.reset(b);
+            uint32_t block_end=std::min((b + 1) * BLOCK_SIZE, size_);
+            for (uint32_t i=b * BLOCK_SIZE; i < block_end; i++) {
+                if (angular_velocity[i] != 0.f) {
+                    moving_.set(b);
+                    break;
+                }
+            }
+        }
+    }
+
+    // evaluate the first count lights at time into pos_ranges. only blocks
+    // with moving lights (when time changed) or edited lights are evaluated,
+    // they are left in pos_dirty
+    void update(float time, uint32_t count)
+    {
+        if (time != time_) {
+            pos_dirty_.merge(moving_);
+            time_=time;
+        }
+
+        Light_anim_args args
+        {
+            time,
+            center_x.data(), center_y.data(), center_z.data(),
+            radius.data(), elevation.data(), angular_velocity.data(), phase.data(),
+            range.data(),
+            pos_x.data(), pos_y.data(), pos_z.data(),
+            pos_ranges.data()
+        };
+        pos_dirty_.for_each_run(block_count(count), [&](uint32_t begin_block, uint32_t end_block) {
+            uint32_t begin=begin_block * BLOCK_SIZE;
+            uint32_t end=std::min(end_block * BLOCK_SIZE, count);
+            animate_fn_(args, begin, end);
+            if (packed_) pack_pos_ranges_(begin, end);
+        });
+    }
+
+    // blocks changed since the last clear_dirty
+    const Block_bits &pos_dirty() const
+    {
+        return pos_dirty_;
+    }
+
+    const Block_bits &color_dirty() const
+    {
+        return color_dirty_;
+    }
+
+    void clear_dirty()
+    {
+        pos_dirty_.clear();
+        color_dirty_.clear();
+    }
+
+    // force a full re-evaluation and upload, e.g. after the gpu wrote positions
+    void mark_all_dirty()
+    {
+        pos_dirty_.set_all();
+        color_dirty_.set_all();
+    }
+
+    // copy lights [begin, end) to the same offset of a buffer holding all lights
+    // in the packed layout if enabled
+    void write_pos_ranges(uint32_t begin, uint32_t end, void *p_pos_ranges) const
+    {
+        if (packed_) {
+            memcpy(reinterpret_cast<uint32_t *>(p_pos_ranges) + begin * 2,
+                   packed_pos_ranges.data() + begin * 2,
+                   (end - begin) * 2 * sizeof(uint32_t));
+        }
+        else {
+            memcpy(reinterpret_cast<float *>(p_pos_ranges) + begin * 4,
+                   pos_ranges.data() + begin * 4,
+                   (end - begin) * 4 * sizeof(float));
+        }
+    }
+
+    void write_colors(uint32_t begin, uint32_t end, void *p_colors) const
+    {
+        memcpy(reinterpret_cast<uint32_t *>(p_colors) + begin,
+               color.data() + begin,
+               (end - begin) * sizeof(uint32_t));
+    }
+
+    // writes the indices of the lights in [0, count) whose sphere touches
+    // the frustum to p_visible in increasing order and returns their number.
+    // uses the host positions, so update has to be called first
+    uint32_t cull(base::Thread_pool &pool, const glm::vec4 planes[6], uint32_t count, uint32_t *p_visible)
+    {
+        Light_cull_args args{pos_x.data(), pos_y.data(), pos_z.data(), range.data()};
+        for (int p=0; p < 6; p++) {
+            for (int k=0; k < 4; k++) args.planes[p][k]=planes[p][k];
+        }
+
+        // fixed chunks are compacted in place, then moved next to each other
+        const uint32_t CHUNK_SIZE=16 * BLOCK_SIZE;
+        const uint32_t chunk_count=(count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        cull_counts_.resize(chunk_count);
+        pool.parallel_for(chunk_count, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t c=begin; c < end; c++) {
+                const uint32_t chunk_begin=c * CHUNK_SIZE;
+                const uint32_t chunk_end=std::min(count, chunk_begin + CHUNK_SIZE);
+                cull_counts_[c]=cull_fn_(args, chunk_begin, chunk_end, p_visible + chunk_begin);
+            }
+        });
+        uint32_t n=0;
+        for (uint32_t c=0; c < chunk_count; c++) {
+            if (n != c * CHUNK_SIZE) memmove(p_visible + n, p_visible + c * CHUNK_SIZE, cull_counts_[c] * sizeof(uint32_t));
+            n+=cull_counts_[c];
+        }
+        return n;
+    }
+
+    // multiply the ranges of [begin, end) by scale
+    void scale_ranges(float scale, uint32_t begin, uint32_t end)
+    {
+        float *p=range.data();
+        uint32_t i=begin;
+        for (; i < end && (i & 3); i++) p[i]*=scale;
+        // sse is baseline on x86-64, the stream is 64-byte aligned
+        const __m128 s=_mm_set1_ps(scale);
+        for (; i + 4 <= end; i+=4) _mm_store_ps(p + i, _mm_mul_ps(_mm_load_ps(p + i), s));
+        for (; i < end; i++) p[i]*=scale;
+        if (begin < end) pos_dirty_.set_range(begin / BLOCK_SIZE, block_count(end));
+    }
+
+    // orbit parameters of [begin, end) for the gpu animation pass, 2 vec4 per
+    // light (center, radius), (elevation, angular velocity, phase, range)
+    void write_orbits(uint32_t begin, uint32_t end, float *p_orbits) const
+    {
+        for (uint32_t i=begin; i < end; i++) {
+            float *p=p_orbits + (i - begin) * 8;
+            p[0]=center_x[i];
+            p[1]=center_y[i];
+            p[2]=center_z[i];
+            p[3]=radius[i];
+            p[4]=elevation[i];
+            p[5]=angular_velocity[i];
+            p[6]=phase[i];
+            p[7]=range[i];
+        }
+    }
+
+private:
+    // 10 bits to every third bit of 30
+    static uint32_t spread_bits_(uint32_t v)
+    {
+        v=(v | (v << 16)) & 0x030000ff;
+        v=(v | (v << 8)) & 0x0300f00f;
+        v=(v | (v << 4)) & 0x030c30c3;
+        v=(v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    // stream[j]=stream[order[j]] for the first size_ lights
+    template<typename T>
+    void permute_(base::Thread_pool &pool, T *p_stream, uint32_t stride, const uint32_t *p_order)
+    {
+        T *p_tmp=reinterpret_cast<T *>(permute_tmp_.data());
+        memcpy(p_tmp, p_stream, size_ * stride * sizeof(T));
+        pool.parallel_for(size_, 16384, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t j=begin; j < end; j++) {
+                for (uint32_t k=0; k < stride; k++) p_stream[j * stride + k]=p_tmp[p_order[j] * stride + k];
+            }
+        });
+    }
+
+    void move_light_(uint32_t dst, uint32_t src)
+    {
+        pos_x[dst]=pos_x[src];
+        pos_y[dst]=pos_y[src];
+        pos_z[dst]=pos_z[src];
+        memcpy(&pos_ranges[dst * 4], &pos_ranges[src * 4], 4 * sizeof(float));
+        if (packed_) memcpy(&packed_pos_ranges[dst * 2], &packed_pos_ranges[src * 2], 2 * sizeof(uint32_t));
+        range[dst]=range[src];
+        color[dst]=color[src];
+        id[dst]=id[src];
+        center_x[dst]=center_x[src];
+        center_y[dst]=center_y[src];
+        center_z[dst]=center_z[src];
+        radius[dst]=radius[src];
+        elevation[dst]=elevation[src];
+        angular_velocity[dst]=angular_velocity[src];
+        phase[dst]=phase[src];
+    }
+
+    // same rounding as packUnorm2x16 / packHalf2x16 in animate_lights.comp
+    void pack_pos_ranges_(uint32_t begin, uint32_t end)
+    {
+        const glm::vec3 scale=65535.f / bounds_extent_;
+        const float pad=packing_error();
+        for (uint32_t i=begin; i < end; i++) {
+            uint32_t q[3];
+            const float p[3]={pos_x[i], pos_y[i], pos_z[i]};
+            for (int k=0; k < 3; k++) {
+                float n=(p[k] - bounds_min_[k]) * scale[k];
+                q[k]=static_cast<uint32_t>(std::min(65535.f, std::max(0.f, n)) + 0.5f);
+            }
+            const float r=range[i] * (1.f + 1.f / 512.f) + pad;
+            packed_pos_ranges[i * 2 + 0]=q[0] | (q[1] << 16);
+            packed_pos_ranges[i * 2 + 1]=q[2] | (static_cast<uint32_t>(base::float_to_half(r)) << 16);
+        }
+    }
+
+    uint32_t size_{0};
+    uint32_t capacity_;
+    base::Simd_level simd_level_{base::SIMD_SCALAR};
+    Animate_lights_fn animate_fn_{animate_lights_scalar};
+    Cull_lights_fn cull_fn_{cull_lights_scalar};
+
+    bool packed_{false};
+    glm::vec3 bounds_min_{0.f};
+    glm::vec3 bounds_extent_{1.f};
+
+    float time_{-1.f};
+    Block_bits moving_; // blocks with at least one orbiting light
+    Block_bits pos_dirty_;
+    Block_bits color_dirty_;
+
+    // scratch for sort_by_position
+    std::vector<uint32_t> sort_keys_;
+    std::vector<uint32_t> sort_order_;
+    std::vector<uint32_t> sort_tmp_keys_;
+    std::vector<uint32_t> sort_tmp_order_;
+    std::vector<uint64_t> permute_tmp_;
+
+    // visible lights per chunk for cull
+    std::vector<uint32_t> cull_counts_;
+};
@@ -1,8 +1,38 @@
 #pragma once
 #include <Prog_info_base.hpp>
+#include "Workgroup_sizes.hpp"
+#include <depth_keys.glsl>
 #include <algorithm>
 #include <string>
 
+enum Grid_offsets_mode
+{
+    GRID_OFFSETS_PREFIX_SUM, // deterministic light list
+    GRID_OFFSETS_ATOMIC,
+    GRID_OFFSETS_ACTIVE_CLUSTERS, // atomic, indirect dispatch over the flagged clusters only
+    GRID_OFFSETS_MODE_COUNT
+};
+
+enum Light_assignment
+{
+    LIGHT_ASSIGNMENT_LIST, // counts, offsets, light list
+    LIGHT_ASSIGNMENT_MASKS, // one bit per light and cluster, up to MAX_MASK_LIGHTS lights
+    LIGHT_ASSIGNMENT_Z_BINS, // depth sorted lights, slot range per z slice and bit per tile, up to MAX_Z_BIN_LIGHTS lights
+    LIGHT_ASSIGNMENT_LINKED_LISTS, // light nodes pushed onto per cluster lists in one pass
+    LIGHT_ASSIGNMENT_COMPACTED_LISTS, // linked lists flattened into the light list
+    LIGHT_ASSIGNMENT_CLUSTER_LISTS, // light list from a workgroup per tile column, no global atomics
+    LIGHT_ASSIGNMENT_BALANCED_LISTS, // light list over fixed size chunks of the light cells
+    LIGHT_ASSIGNMENT_COUNT
+};
+
+inline const char *light_assignment_str(Light_assignment assignment)
+{
+    static const char *strs[LIGHT_ASSIGNMENT_COUNT]={"light list", "light masks", "z-bins, tile masks",
+                                                     "linked lists", "linked lists, compacted", "light list, per cluster",
+                                                     "light list, chunked"};
+    return strs[assignment];
+}
+
 class Prog_info : public base::Prog_info_base
 {
 public:
@@ -12,7 +42,32 @@ public:
     uint32_t MIN_NUM_LIGHTS{1024};
     uint32_t MAX_NUM_LIGHTS{600000};
     uint32_t num_lights{0};
+    uint32_t MAX_MASK_LIGHTS{1024}; // light mask bits per cluster, a mask word per 32 lights in every fragment
+    uint32_t MAX_Z_BIN_LIGHTS{DEPTH_KEY_MAX_LIGHTS}; // light mask bits per tile, the light index bits of the depth keys
     bool gen_lights{false};
+    bool resize_lights{false};
+    bool incremental_light_resize{true}; // keep existing lights when the count changes
+    bool rescale_light_ranges{true}; // rescale kept ranges to the new light density
+    uint64_t LIGHT_SEED{0x4c49474854ull}; // same lights on every run and thread count
+    bool gpu_light_animation{false};
+    bool pause_light_animation{false};
+    bool packed_lights{false}; // 8 byte light format, fixed at startup
+    uint32_t light_sort_interval{0}; // frames between morton sorts, 0 = off
+    float animated_light_fraction{1.f}; // share of light blocks that orbit
+    bool cpu_light_culling{false}; // frustum cull on the host, cpu animation only
+    Grid_offsets_mode grid_offsets_mode{GRID_OFFSETS_PREFIX_SUM};
+    bool refine_light_cells{false}; // sphere against cluster aabb test inside the light bounds
+    Light_assignment light_assignment{LIGHT_ASSIGNMENT_LIST};
+    bool benchmark{false}; // time the light assignments over light counts, then quit
+    bool record_camera_path{false}; // camera poses replayed by the autotune
+    std::string camera_path_file; // loads the camera path at startup, saves it when a recording stops
+    bool autotune{false}; // time the grid configurations over the camera path, keep the fastest
+    uint32_t light_list_capacity{256 * 1024}; // LIGHT_LIST_MAX_LENGTH of the shaders, follows the demand read back from the frames
+    uint32_t LIGHT_LIST_MIN_CAPACITY{64 * 1024};
+    uint32_t LIGHT_LIST_MAX_CAPACITY{16 * 1024 * 1024};
+    bool compact_light_indices{true}; // r16ui light list while the light indices fit
+    Workgroup_sizes workgroup_sizes; // cached per device
+    bool tune_workgroup_sizes{false}; // time the local sizes, cache the fastest
 
     uint32_t TILE_WIDTH{64};
     uint32_t TILE_HEIGHT{64};
@@ -20,6 +75,8 @@ public:
     uint32_t tile_count_x{0};
     uint32_t tile_count_y{0};
     uint32_t TILE_COUNT_Z{256};
+    uint32_t MIN_TILE_SIZE{32}; // autotune limits of the grid buffers
+    uint32_t MAX_TILE_COUNT_Z{512};
 
     Prog_info()
     {
@@ -59,16 +116,102 @@ public:
     void increase_num_lights()
     {
         num_lights=std::min(MAX_NUM_LIGHTS, num_lights * 2);
-        gen_lights=true;
+        request_light_update_();
     }
 
     void decrease_num_lights()
     {
         num_lights=std::max(MIN_NUM_LIGHTS, num_lights / 2);
+        request_light_update_();
+    }
+
+    void toggle_gpu_light_animation()
+    {
+        gpu_light_animation=!gpu_light_animation;
+    }
+
+    void toggle_pause_light_animation()
+    {
+        pause_light_animation=!pause_light_animation;
+    }
+
+    // 100% -> 50% -> 10% -> 0% -> 100%, regenerates the lights
+    void cycle_animated_light_fraction()
+    {
+        if (animated_light_fraction > 0.5f) animated_light_fraction=0.5f;
+        else if (animated_light_fraction > 0.1f) animated_light_fraction=0.1f;
+        else if (animated_light_fraction > 0.f) animated_light_fraction=0.f;
+        else animated_light_fraction=1.f;
         gen_lights=true;
     }
 
+    // off -> every frame -> every 30 frames -> off
+    void cycle_light_sort_interval()
+    {
+        if (light_sort_interval == 0) light_sort_interval=1;
+        else if (light_sort_interval == 1) light_sort_interval=30;
+        else light_sort_interval=0;
+    }
+
+    void toggle_cpu_light_culling()
+    {
+        cpu_light_culling=!cpu_light_culling;
+    }
+
+    // prefix sum -> atomic -> active clusters -> prefix sum
+    void cycle_grid_offsets_mode()
+    {
+        grid_offsets_mode=static_cast<Grid_offsets_mode>((grid_offsets_mode + 1) % GRID_OFFSETS_MODE_COUNT);
+    }
+
+    void toggle_refine_light_cells()
+    {
+        refine_light_cells=!refine_light_cells;
+    }
+
+    // the light list takes over from the masks above MAX_MASK_LIGHTS lights
+    // and from the z-bins above MAX_Z_BIN_LIGHTS
+    void cycle_light_assignment()
+    {
+        light_assignment=static_cast<Light_assignment>((light_assignment + 1) % LIGHT_ASSIGNMENT_COUNT);
+    }
+
+    Light_assignment used_light_assignment() const
+    {
+        if (light_assignment == LIGHT_ASSIGNMENT_MASKS && num_lights > MAX_MASK_LIGHTS) return LIGHT_ASSIGNMENT_LIST;
+        if (light_assignment == LIGHT_ASSIGNMENT_Z_BINS && num_lights > MAX_Z_BIN_LIGHTS) return LIGHT_ASSIGNMENT_LIST;
+        return light_assignment;
+    }
+
+    void toggle_camera_path_recording()
+    {
+        record_camera_path=!record_camera_path;
+    }
+
+    // ends the recording, the benchmark goes first
+    void start_autotune()
+    {
+        record_camera_path=false;
+        autotune=!benchmark;
+    }
+
+    void toggle_incremental_light_resize()
+    {
+        incremental_light_resize=!incremental_light_resize;
+    }
+
+    void toggle_rescale_light_ranges()
+    {
+        rescale_light_ranges=!rescale_light_ranges;
+    }
+
 private:
+    void request_light_update_()
+    {
+        if (incremental_light_resize) resize_lights=true;
+        else gen_lights=true;
+    }
+
     uint32_t width_{800};
     uint32_t height_{600};
     std::string prog_name_{"Clustered forward demo"};
@@ -4,6 +4,7 @@
 #include <Buffer.hpp>
 #include <Camera.hpp>
 #include <random.hpp>
+#include <Thread_pool.hpp>
 #include <color.hpp>
 #include <Aabb.hpp>
 #include <Shader.hpp>
@@ -14,20 +15,66 @@
 #include "Swapchain.hpp"
 #include "Shell.hpp"
 #include "Text_overlay.hpp"
+#include "Benchmark.hpp"
+#include "Autotune.hpp"
+#include "Workgroup_tune.hpp"
+#include "group_sizes.glsl"
 
 #include <queue>
+#include <cstddef>
+#include <limits>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "simple.vert.h"
 #include "clustering.vert.h"
 #include "clustering.frag.h"
+#include "animate_lights.comp.h"
 #include "calc_light_grids.comp.h"
 #include "calc_grid_offsets.comp.h"
+#include "scan_grid_light_counts.comp.h"
+#include "add_grid_block_offsets.comp.h"
+#include "scan_grid_light_counts_chunks.comp.h"
+#include "add_grid_block_offsets_chunks.comp.h"
+#include "calc_active_grid_offsets.comp.h"
+#include "calc_light_count_stats.comp.h"
 #include "calc_light_list.comp.h"
+#include "sort_light_depths.comp.h"
+#include "calc_z_bins.comp.h"
+#include "compact_light_lists.comp.h"
+#include "calc_cluster_lights.comp.h"
+#include "calc_cluster_lights_list.comp.h"
+#include "calc_light_chunks.comp.h"
+#include "calc_light_chunks_list.comp.h"
+#include "calc_light_list_indices16.comp.h"
+#include "compact_light_lists_indices16.comp.h"
+#include "calc_cluster_lights_list_indices16.comp.h"
+#include "calc_light_chunks_list_indices16.comp.h"
 
 #include "cluster_forward.vert.h"
 #include "cluster_forward.frag.h"
 #include "light_particles.vert.h"
+#include "animate_lights_packed.comp.h"
+#include "calc_light_grids_packed.comp.h"
+#include "cluster_forward_packed.frag.h"
+#include "cluster_forward_indices16.frag.h"
+#include "cluster_forward_packed_indices16.frag.h"
+#include "calc_light_grids_masks.comp.h"
+#include "calc_light_grids_packed_masks.comp.h"
+#include "cluster_forward_masks.frag.h"
+#include "cluster_forward_packed_masks.frag.h"
+#include "calc_light_grids_z_bins.comp.h"
+#include "calc_light_grids_packed_z_bins.comp.h"
+#include "cluster_forward_z_bins.frag.h"
+#include "cluster_forward_packed_z_bins.frag.h"
+#include "calc_light_grids_linked_lists.comp.h"
+#include "calc_light_grids_packed_linked_lists.comp.h"
+#include "cluster_forward_linked_lists.frag.h"
+#include "cluster_forward_packed_linked_lists.frag.h"
+#include "calc_light_grids_bounds.comp.h"
+#include "calc_light_grids_packed_bounds.comp.h"
+#include "calc_light_grids_chunks.comp.h"
+#include "calc_light_grids_packed_chunks.comp.h"
+#include "light_particles_packed.vert.h"
 #include "light_particles.frag.h"
 
 // return in millsec
@@ -72,12 +119,15 @@ public:
 	destroy_command_pools_();
 	destroy_back_buffers_();
 	destroy_texel_buffers_();
+	destroy_tuners_();
     }
 
     void init() override
     {
 	base::Program_base::init();
+	init_light_index_format_();
 	init_texel_buffers_();
+	init_tuners_();
 	init_back_buffers_();
 	init_command_pools_();
 	init_model_();
@@ -92,32 +142,50 @@ public:
 	init_pipelines_();
     }
 
+    // regenerate every light for the current light count
     void generate_lights()
     {
-	assert(p_model_);
-	const base::Aabb &aabb=p_model_->get_aabb();
-	lights_.clear();
-	const float light_vol=aabb.get_volume() / static_cast<float>(p_info_->num_lights);
-	const float base_range=powf(light_vol, 1.f / 3.f);
-	const float max_range=base_range * 3.f;
-	const float min_range=base_range / 1.5f;
-	const glm::vec3 half_size=aabb.get_half_size();
-	const float pos_radius=std::max(half_size.x, std::max(half_size.y, half_size.z));
-	glm::vec3 fcol;
-	glm::u8vec4 col;
-	for (auto i=0; i < p_info_->num_lights; ++i) {
-	    float range=base::random_range(min_range, max_range);
-	    base::hue_to_rgb(fcol, base::random_range(0.f, 1.f));
-	    fcol*=1.3f;
-	    fcol-=0.15f;
-	    base::float_to_rgbunorm(col, fcol);
-	    glm::vec3 pos{base::random_range(-pos_radius, pos_radius),
-		base::random_range(-pos_radius, pos_radius),
-		base::random_range(-pos_radius, pos_radius)};
-	    lights_.emplace_back(pos, col, range);
+	light_base_range_=calc_light_base_range_();
+	p_lights_->resize(p_info_->num_lights);
+	generate_lights_(0, p_info_->num_lights);
+	light_orbits_valid_count_=0;
+    }
+
+    // append or truncate to the current light count, kept lights are untouched
+    // unless their ranges are rescaled to the new light density
+    void resize_lights()
+    {
+	const uint32_t old_count=p_lights_->size();
+	const uint32_t new_count=p_info_->num_lights;
+	if (new_count < old_count) {
+	    // sorted lights are compacted, the orbits behind the first moved one are stale
+	    uint32_t first_changed=p_lights_->truncate(new_count);
+	    light_orbits_valid_count_=std::min(light_orbits_valid_count_, first_changed);
+	}
+	const float base_range=calc_light_base_range_();
+	if (p_info_->rescale_light_ranges) {
+	    p_lights_->scale_ranges(base_range / light_base_range_, 0, std::min(old_count, new_count));
+	    light_base_range_=base_range;
+	    light_orbits_valid_count_=0;
+	}
+	if (new_count > old_count) {
+	    p_lights_->resize(new_count);
+	    generate_lights_(old_count, new_count);
 	}
     }
 
+    // spatially reorder the lights so that the lights of one cluster sit
+    // close together in light_pos_ranges and light_colors
+    void sort_lights(float light_time)
+    {
+	base::Timer timer;
+	// positions of the sort time, also in gpu animation mode
+	p_lights_->update(light_time, p_lights_->size());
+	p_lights_->sort_by_position(*p_thread_pool_);
+	light_orbits_valid_count_=0;
+	light_sort_ms_=static_cast<float>(timer.get() * 1000.0);
+    }
+
 private:
     Prog_info * p_info_{nullptr};
     Shell *p_shell_{nullptr};
@@ -142,11 +210,12 @@ private:
 		     const vk::SharingMode sharing_mode,
 		     const uint32_t queue_family_count,
 		     const uint32_t *p_queue_family,
-		     const vk::Format view_format)
+		     const vk::Format view_format,
+		     const vk::BufferUsageFlags extra_usage={})
 	    : p_dev_(p_dev)
 	{
 	    p_buf=new base::Buffer(p_dev_,
-				   usage_,
+				   usage_ | extra_usage,
 				   mem_prop_flags,
 				   size,
 				   sharing_mode,
@@ -161,12 +230,29 @@ private:
 	    if (p_buf) delete p_buf;
 	    if (mem_) p_dev_->dev.freeMemory(mem_);
 	}
+
+	// device local buffers only, blocks until the copy is done
+	void upload(base::Physical_device *p_phy_dev,
+		    const vk::CommandBuffer &cmd_buf,
+		    vk::DeviceSize size,
+		    void *p_data,
+		    vk::DeviceSize offset=0)
+	{
+	    base::update_device_local_buffer_memory(p_phy_dev, p_dev_, p_buf, mem_,
+						    size, p_data, offset,
+						    vk::PipelineStageFlagBits::eComputeShader,
+						    vk::PipelineStageFlagBits::eComputeShader,
+						    vk::AccessFlagBits::eShaderRead,
+						    vk::AccessFlagBits::eShaderRead,
+						    cmd_buf);
+	}
     private:
 	base::Device *p_dev_;
 	vk::BufferUsageFlags usage_{vk::BufferUsageFlagBits::eStorageTexelBuffer | vk::BufferUsageFlagBits::eTransferDst};
 	vk::DeviceMemory mem_;
     };
 
+    uint32_t max_grid_count_{0}; // clusters the grid buffers hold
     Texel_buffer *p_grid_flags_{nullptr};
     Texel_buffer *p_light_bounds_{nullptr};
     Texel_buffer *p_grid_light_counts_{nullptr};
@@ -174,6 +260,22 @@ private:
     Texel_buffer *p_grid_light_count_offsets_{nullptr};
     Texel_buffer *p_light_list_{nullptr};
     Texel_buffer *p_grid_light_counts_compare_{nullptr};
+    Texel_buffer *p_light_orbits_{nullptr};
+    Texel_buffer *p_grid_block_sums_{nullptr};
+    vk::BufferView grid_flag_words_view_; // r32ui view of grid_flags
+    Texel_buffer *p_active_clusters_{nullptr};
+    Texel_buffer *p_active_cluster_dispatch_{nullptr};
+    Texel_buffer *p_light_view_spheres_{nullptr};
+    Texel_buffer *p_light_masks_{nullptr};
+    Texel_buffer *p_light_depth_keys_{nullptr};
+    Texel_buffer *p_z_bins_{nullptr};
+    Texel_buffer *p_tile_light_masks_{nullptr};
+    Texel_buffer *p_grid_light_heads_{nullptr};
+    Texel_buffer *p_light_nodes_{nullptr};
+    Texel_buffer *p_light_chunks_{nullptr};
+    Texel_buffer *p_light_chunk_dispatch_{nullptr};
+    Texel_buffer *p_light_chunk_counts_{nullptr};
+    Texel_buffer *p_light_chunk_offsets_{nullptr};
 
     void init_texel_buffers_()
     {
@@ -190,9 +292,13 @@ private:
 	    queue_families.empty() ? nullptr : queue_families.data();
 	uint32_t queue_family_count=
 	    queue_families.empty() ? 0 : static_cast<uint32_t>(queue_families.size());
-	const uint32_t max_grid_count=((p_info_->MAX_WIDTH - 1) / p_info_->TILE_WIDTH + 1) *
+	// grid configurations of the autotuner fit as long as their grid count does
+	max_grid_count_=((p_info_->MAX_WIDTH - 1) / p_info_->TILE_WIDTH + 1) *
 	    ((p_info_->MAX_HEIGHT - 1) / p_info_->TILE_HEIGHT + 1) *
 	    p_info_->TILE_COUNT_Z;
+	const uint32_t max_grid_count=max_grid_count_;
+	const uint32_t max_tile_count=((p_info_->MAX_WIDTH - 1) / p_info_->MIN_TILE_SIZE + 1) *
+	    ((p_info_->MAX_HEIGHT - 1) / p_info_->MIN_TILE_SIZE + 1);
 
 	p_grid_flags_=new Texel_buffer(p_phy_dev_, p_dev_,
 				       device_local,
@@ -204,9 +310,9 @@ private:
 	p_light_bounds_=new Texel_buffer(p_phy_dev_,
 					 p_dev_,
 					 device_local,
-					 p_info_->MAX_NUM_LIGHTS * 6 * sizeof(uint32_t),
+					 p_info_->MAX_NUM_LIGHTS * 2 * sizeof(uint32_t),
 					 sharing_mode, queue_family_count, p_queue_family,
-					 vk::Format::eR32Uint); // max tile count 1d (z 256)
+					 vk::Format::eR32G32Uint); // packed (min, max) grid coord, light_bounds.glsl
 
 	p_grid_light_counts_=new Texel_buffer(p_phy_dev_,
 					      p_dev_,
@@ -220,7 +326,8 @@ private:
 						   device_local,
 						   1 * sizeof(uint32_t),
 						   sharing_mode, queue_family_count, p_queue_family,
-						   vk::Format::eR32Uint); // light count total * max grid count
+						   vk::Format::eR32Uint, // light count total * max grid count
+						   vk::BufferUsageFlagBits::eTransferSrc); // read back for the list capacity
 
 	p_grid_light_count_offsets_=new Texel_buffer(p_phy_dev_,
 						     p_dev_,
@@ -229,11 +336,7 @@ private:
 						     sharing_mode, queue_family_count, p_queue_family,
 						     vk::Format::eR32Uint); // same as above
 
-	p_light_list_=new Texel_buffer(p_phy_dev_, p_dev_,
-				       device_local,
-				       1024 * 1024 * sizeof(uint32_t),
-				       sharing_mode, queue_family_count, p_queue_family,
-				       vk::Format::eR32Uint); // light idx
+	init_light_list_buffers_();
 
 	p_grid_light_counts_compare_=new Texel_buffer(p_phy_dev_,
 						      p_dev_,
@@ -241,6 +344,170 @@ private:
 						      max_grid_count * sizeof(uint32_t),
 						      sharing_mode, queue_family_count, p_queue_family,
 						      vk::Format::eR32Uint); // light count / grid
+
+	p_light_orbits_=new Texel_buffer(p_phy_dev_,
+					 p_dev_,
+					 device_local,
+					 p_info_->MAX_NUM_LIGHTS * 2 * sizeof(glm::vec4),
+					 sharing_mode, queue_family_count, p_queue_family,
+					 vk::Format::eR32G32B32A32Sfloat); // (center, radius), (elevation, angular velocity, phase, range)
+
+	p_grid_block_sums_=new Texel_buffer(p_phy_dev_,
+					    p_dev_,
+					    device_local,
+					    (std::max(max_grid_count, p_info_->MAX_NUM_LIGHTS) - 1) / SCAN_BLOCK_SIZE * sizeof(uint32_t) + sizeof(uint32_t),
+					    sharing_mode, queue_family_count, p_queue_family,
+					    vk::Format::eR32Uint); // light or chunk count / scan block
+
+	// clustering.frag sets flags atomically through it, max_grid_count is a multiple of 4
+	grid_flag_words_view_=p_dev_->dev.createBufferView(
+	    vk::BufferViewCreateInfo({},
+				     p_grid_flags_->p_buf->buf,
+				     vk::Format::eR32Uint,
+				     0,
+				     VK_WHOLE_SIZE));
+
+	p_active_clusters_=new Texel_buffer(p_phy_dev_,
+					    p_dev_,
+					    device_local,
+					    max_grid_count * sizeof(uint32_t),
+					    sharing_mode, queue_family_count, p_queue_family,
+					    vk::Format::eR32Uint); // grid idx of the flagged clusters
+
+	p_active_cluster_dispatch_=new Texel_buffer(p_phy_dev_,
+						    p_dev_,
+						    device_local,
+						    4 * sizeof(uint32_t),
+						    sharing_mode, queue_family_count, p_queue_family,
+						    vk::Format::eR32Uint, // vk::DispatchIndirectCommand, active cluster count
+						    vk::BufferUsageFlagBits::eIndirectBuffer);
+
+	p_light_view_spheres_=new Texel_buffer(p_phy_dev_,
+					       p_dev_,
+					       device_local,
+					       p_info_->MAX_NUM_LIGHTS * sizeof(glm::vec4),
+					       sharing_mode, queue_family_count, p_queue_family,
+					       vk::Format::eR32G32B32A32Sfloat); // (view space pos, range) for refined light cells
+
+	init_light_mask_buffer_();
+
+	p_light_depth_keys_=new Texel_buffer(p_phy_dev_,
+					     p_dev_,
+					     device_local,
+					     p_info_->MAX_Z_BIN_LIGHTS * sizeof(uint32_t),
+					     sharing_mode, queue_family_count, p_queue_family,
+					     vk::Format::eR32Uint); // view depth bits | light idx, sorted
+
+	p_z_bins_=new Texel_buffer(p_phy_dev_,
+				   p_dev_,
+				   device_local,
+				   p_info_->MAX_TILE_COUNT_Z * 2 * sizeof(uint32_t),
+				   sharing_mode, queue_family_count, p_queue_family,
+				   vk::Format::eR32Uint); // ~first, last + 1 sorted slot / z slice
+
+	p_tile_light_masks_=new Texel_buffer(p_phy_dev_,
+					     p_dev_,
+					     device_local,
+					     max_tile_count * (p_info_->MAX_Z_BIN_LIGHTS / 32) * sizeof(uint32_t),
+					     sharing_mode, queue_family_count, p_queue_family,
+					     vk::Format::eR32Uint); // sorted slot bits / tile
+
+	p_grid_light_heads_=new Texel_buffer(p_phy_dev_,
+					     p_dev_,
+					     device_local,
+					     max_grid_count * sizeof(uint32_t),
+					     sharing_mode, queue_family_count, p_queue_family,
+					     vk::Format::eR32Uint); // first light node / grid, 0: empty
+
+	p_light_chunk_dispatch_=new Texel_buffer(p_phy_dev_,
+						 p_dev_,
+						 device_local,
+						 4 * sizeof(uint32_t),
+						 sharing_mode, queue_family_count, p_queue_family,
+						 vk::Format::eR32Uint, // vk::DispatchIndirectCommand, chunk count
+						 vk::BufferUsageFlagBits::eIndirectBuffer |
+						 vk::BufferUsageFlagBits::eTransferSrc); // chunk count read back for the chunk capacity
+
+	p_light_chunk_counts_=new Texel_buffer(p_phy_dev_,
+					       p_dev_,
+					       device_local,
+					       p_info_->MAX_NUM_LIGHTS * sizeof(uint32_t),
+					       sharing_mode, queue_family_count, p_queue_family,
+					       vk::Format::eR32Uint); // chunks / processed light
+
+	p_light_chunk_offsets_=new Texel_buffer(p_phy_dev_,
+						p_dev_,
+						device_local,
+						p_info_->MAX_NUM_LIGHTS * sizeof(uint32_t),
+						sharing_mode, queue_family_count, p_queue_family,
+						vk::Format::eR32Uint); // first chunk inside the scan block / processed light
+    }
+
+    // light_list and light_nodes hold p_info_->light_list_capacity entries,
+    // light_chunks light_chunk_capacity_ chunks, recreated when a capacity or
+    // the light index format changes
+    void init_light_list_buffers_()
+    {
+	std::vector<uint32_t> queue_families;
+	if (p_phy_dev_->graphics_queue_family_idx != p_phy_dev_->compute_queue_family_idx) {
+	    queue_families.emplace_back(p_phy_dev_->graphics_queue_family_idx);
+	    queue_families.emplace_back(p_phy_dev_->compute_queue_family_idx);
+	}
+
+	vk::MemoryPropertyFlags device_local{vk::MemoryPropertyFlagBits::eDeviceLocal};
+	vk::SharingMode sharing_mode=
+	    queue_families.empty() ? vk::SharingMode::eExclusive : vk::SharingMode::eConcurrent;
+	uint32_t *p_queue_family=
+	    queue_families.empty() ? nullptr : queue_families.data();
+	uint32_t queue_family_count=
+	    queue_families.empty() ? 0 : static_cast<uint32_t>(queue_families.size());
+
+	p_light_list_=new Texel_buffer(p_phy_dev_, p_dev_,
+				       device_local,
+				       p_info_->light_list_capacity * (light_indices_16_ ? sizeof(uint16_t) : sizeof(uint32_t)),
+				       sharing_mode, queue_family_count, p_queue_family,
+				       light_indices_16_ ? vk::Format::eR16Uint : vk::Format::eR32Uint); // light idx
+
+	p_light_nodes_=new Texel_buffer(p_phy_dev_,
+					p_dev_,
+					device_local,
+					(p_info_->light_list_capacity + 1) * 2 * sizeof(uint32_t),
+					sharing_mode, queue_family_count, p_queue_family,
+					vk::Format::eR32Uint, // node count, then (light idx, next node) / node
+					vk::BufferUsageFlagBits::eTransferSrc); // node count read back for the list capacity
+
+	p_light_chunks_=new Texel_buffer(p_phy_dev_,
+					 p_dev_,
+					 device_local,
+					 light_chunk_capacity_ * 2 * sizeof(uint32_t),
+					 sharing_mode, queue_family_count, p_queue_family,
+					 vk::Format::eR32Uint); // (light idx, first cell) / chunk
+    }
+
+    // light_masks holds light_mask_capacity_ words, recreated when the grid
+    // and light count of the masks need more
+    void init_light_mask_buffer_()
+    {
+	std::vector<uint32_t> queue_families;
+	if (p_phy_dev_->graphics_queue_family_idx != p_phy_dev_->compute_queue_family_idx) {
+	    queue_families.emplace_back(p_phy_dev_->graphics_queue_family_idx);
+	    queue_families.emplace_back(p_phy_dev_->compute_queue_family_idx);
+	}
+
+	vk::MemoryPropertyFlags device_local{vk::MemoryPropertyFlagBits::eDeviceLocal};
+	vk::SharingMode sharing_mode=
+	    queue_families.empty() ? vk::SharingMode::eExclusive : vk::SharingMode::eConcurrent;
+	uint32_t *p_queue_family=
+	    queue_families.empty() ? nullptr : queue_families.data();
+	uint32_t queue_family_count=
+	    queue_families.empty() ? 0 : static_cast<uint32_t>(queue_families.size());
+
+	p_light_masks_=new Texel_buffer(p_phy_dev_,
+					p_dev_,
+					device_local,
+					light_mask_capacity_ * sizeof(uint32_t),
+					sharing_mode, queue_family_count, p_queue_family,
+					vk::Format::eR32Uint); // light bits / grid
     }
 
     void destroy_texel_buffers_()
@@ -252,6 +519,22 @@ private:
 	delete p_grid_light_count_total_;
 	delete p_light_list_;
 	delete p_grid_light_counts_compare_;
+	delete p_light_orbits_;
+	delete p_grid_block_sums_;
+	p_dev_->dev.destroyBufferView(grid_flag_words_view_);
+	delete p_active_clusters_;
+	delete p_active_cluster_dispatch_;
+	delete p_light_view_spheres_;
+	delete p_light_masks_;
+	delete p_light_depth_keys_;
+	delete p_z_bins_;
+	delete p_tile_light_masks_;
+	delete p_grid_light_heads_;
+	delete p_light_nodes_;
+	delete p_light_chunks_;
+	delete p_light_chunk_dispatch_;
+	delete p_light_chunk_counts_;
+	delete p_light_chunk_offsets_;
     }
 
     // ************************************************************************
@@ -372,26 +655,135 @@ private:
     // lights
     // ************************************************************************
 
-    Lights lights_;
-
-    float *p_light_position_ranges_{nullptr};
-    char *p_light_colors_{nullptr};
+    Lights *p_lights_{nullptr};
+    base::Thread_pool *p_thread_pool_{nullptr};
+    float light_base_range_{0.f};
+    float light_time_{0.f}; // animation time, stops while paused
+    bool light_pos_from_gpu_{false}; // frame data positions were written by the gpu
+    uint64_t light_upload_bytes_{0}; // host writes to frame data light buffers, last frame
+    vk::CommandBuffer upload_cmd_buf_;
+    uint32_t light_orbits_valid_count_{0}; // lights whose orbits are on the device
+    glm::vec3 light_pos_min_{0.f}; // bounds of every light position, for the packed format
+    uint32_t frames_since_light_sort_{0};
+    float light_sort_ms_{0.f};
+    glm::vec3 light_pos_extent_{0.f};
+    uint32_t visible_light_count_{0}; // lights the compute passes process
+    bool lights_culled_{false}; // visible_light_count_ comes from the frustum culling
+    float light_cull_ms_{0.f};
+    Light_assignment light_assignment_used_{LIGHT_ASSIGNMENT_LIST}; // of the frame being recorded
+    uint32_t light_mask_words_{0}; // per cluster or tile
+    bool assignment_buffers_cleared_{false}; // masks and list heads zeroed once, later frames clear what they set
 
     void init_lights_()
     {
-	// Light objects
-	lights_.reserve(p_info_->MAX_NUM_LIGHTS);
+	p_thread_pool_=new base::Thread_pool();
+	p_lights_=new Lights(p_info_->MAX_NUM_LIGHTS);
+
+	// lights orbit the y axis from inside the generation cube, so they stay
+	// in a cylinder of radius sqrt(2) * pos_radius
+	const float pos_radius=calc_light_pos_radius_();
+	const glm::vec3 half_extent(1.415f * pos_radius, pos_radius, 1.415f * pos_radius);
+	light_pos_min_=-half_extent;
+	light_pos_extent_=2.f * half_extent;
+	p_lights_->set_packing(p_info_->packed_lights, light_pos_min_, light_pos_extent_);
+
 	generate_lights();
 
-	// host data
-	p_light_position_ranges_=reinterpret_cast<float *>(malloc(4 * sizeof(float) * p_info_->MAX_NUM_LIGHTS));
-	p_light_colors_=reinterpret_cast<char *>(malloc(4 * sizeof(char) * p_info_->MAX_NUM_LIGHTS));
+	upload_cmd_buf_=p_dev_->dev.allocateCommandBuffers(
+	    vk::CommandBufferAllocateInfo(graphics_cmd_pool_,
+					  vk::CommandBufferLevel::ePrimary,
+					  1))[0];
     }
 
     void destroy_lights_()
     {
-	delete p_light_position_ranges_;
-	delete p_light_colors_;
+	p_dev_->dev.freeCommandBuffers(graphics_cmd_pool_, 1, &upload_cmd_buf_);
+	delete p_lights_;
+	delete p_thread_pool_;
+    }
+
+    // range of a light at the mean spacing for the current light count
+    float calc_light_base_range_() const
+    {
+	const float light_vol=p_model_->get_aabb().get_volume() / static_cast<float>(p_info_->num_lights);
+	return powf(light_vol, 1.f / 3.f);
+    }
+
+    // vertex fetch format of light_pos_ranges for the particles, the packed
+    // layout is read as 4 x 16 bit unorm with the range bits in w
+    vk::Format light_pos_range_format_() const
+    {
+	return p_info_->packed_lights ? vk::Format::eR16G16B16A16Unorm : vk::Format::eR32G32B32A32Sfloat;
+    }
+
+    // lights start inside a cube of this half size around the origin
+    float calc_light_pos_radius_() const
+    {
+	const glm::vec3 half_size=p_model_->get_aabb().get_half_size();
+	return std::max(half_size.x, std::max(half_size.y, half_size.z));
+    }
+
+    // lights [begin, end) only depend on the seed and their index
+    void generate_lights_(uint32_t begin, uint32_t end)
+    {
+	assert(p_model_);
+	const float base_range=light_base_range_;
+	const float pos_radius=calc_light_pos_radius_();
+	const float min_angular_velocity=0.03f; // rad per second
+	const float max_angular_velocity=0.09f;
+	const float animated_fraction=p_info_->animated_light_fraction;
+	const uint64_t seed=p_info_->LIGHT_SEED;
+	const uint64_t block_stream=1ull << 32; // past the light index streams
+
+	// one random stream per light index keeps the result independent of the split
+	p_thread_pool_->parallel_for(end - begin, 4096, [&](uint32_t chunk_begin, uint32_t chunk_end) {
+	    glm::vec3 fcol;
+	    glm::u8vec4 col;
+	    for (uint32_t i=begin + chunk_begin; i < begin + chunk_end; ++i) {
+		base::Random rnd(seed, i);
+		float range=base_range * rnd.range(1.f / 1.5f, 3.f);
+		base::hue_to_rgb(fcol, rnd.range(0.f, 1.f));
+		fcol*=1.3f;
+		fcol-=0.15f;
+		base::float_to_rgbunorm(col, fcol);
+		glm::vec3 pos;
+		pos.x=rnd.range(-pos_radius, pos_radius);
+		pos.y=rnd.range(-pos_radius, pos_radius);
+		pos.z=rnd.range(-pos_radius, pos_radius);
+		float angular_velocity=rnd.range(min_angular_velocity, max_angular_velocity);
+		// whole blocks are static so that they never need uploading
+		base::Random block_rnd(seed, block_stream + i / Lights::BLOCK_SIZE);
+		if (block_rnd.unit_float() >= animated_fraction) angular_velocity=0.f;
+		// orbit around the y axis through the initial position
+		p_lights_->set(i,
+			       glm::vec3(0.f),
+			       sqrtf(pos.x * pos.x + pos.z * pos.z),
+			       pos.y,
+			       angular_velocity,
+			       atan2f(-pos.z, pos.x),
+			       col,
+			       range);
+	    }
+	});
+	p_lights_->mark_changed(begin, end);
+    }
+
+    // orbits only change on generation or resize, the gpu animation pass
+    // evaluates positions from them every frame. only the lights past the
+    // valid count are copied
+    void upload_light_orbits_()
+    {
+	const uint32_t begin=light_orbits_valid_count_;
+	const uint32_t end=p_lights_->size();
+	std::vector<float> orbits((end - begin) * 8);
+	p_lights_->write_orbits(begin, end, orbits.data());
+
+	// previous frames may still read the buffer
+	p_dev_->dev.waitIdle();
+	p_light_orbits_->upload(p_phy_dev_, upload_cmd_buf_,
+				orbits.size() * sizeof(float), orbits.data(),
+				begin * 8 * sizeof(float));
+	light_orbits_valid_count_=end;
     }
 
     // ************************************************************************
@@ -413,23 +805,44 @@ private:
 
 	glm::vec2 resolution;
 	uint32_t num_lights;
+	float time;
+
+	glm::vec4 light_pos_min; // packed lights bounds
+	glm::vec4 light_pos_extent; // w: packed position error
     } global_uniforms_;
 
+    // matches pc_in of calc_light_grids.comp and calc_light_list.comp
+    struct Light_count_push_constants
+    {
+	uint32_t light_count;
+	uint32_t use_visible_lights;
+	uint32_t refine_light_cells;
+    };
+
     enum Queries
     {
 	QUERY_DEPTH_PASS=0,
 	QUERY_CLUSTERING=1,
-	QUERY_CALC_LIGHT_GRIDS=2,
-	QUERY_CALC_GRID_OFFSETS=3,
-	QUERY_CALC_LIGHT_LIST=4,
-	QUERY_ONSCREEN=5,
-	QUERY_TRANSFER=6,
-	QUERY_HSIZE=7
+	QUERY_ANIMATE_LIGHTS=2,
+	QUERY_CALC_LIGHT_GRIDS=3,
+	QUERY_CALC_GRID_OFFSETS=4,
+	QUERY_CALC_LIGHT_LIST=5,
+	QUERY_ONSCREEN=6,
+	QUERY_TRANSFER=7,
+	QUERY_HSIZE=8
     };
+    // first query and query count of each submission
+    static constexpr uint32_t OFFSCREEN_QUERY_FIRST=QUERY_DEPTH_PASS * 2;
+    static constexpr uint32_t OFFSCREEN_QUERY_COUNT=(QUERY_ANIMATE_LIGHTS - QUERY_DEPTH_PASS) * 2;
+    static constexpr uint32_t COMPUTE_QUERY_FIRST=QUERY_ANIMATE_LIGHTS * 2;
+    static constexpr uint32_t COMPUTE_QUERY_COUNT=(QUERY_ONSCREEN - QUERY_ANIMATE_LIGHTS) * 2;
+    static constexpr uint32_t ONSCREEN_QUERY_FIRST=QUERY_ONSCREEN * 2;
+    static constexpr uint32_t ONSCREEN_QUERY_COUNT=(QUERY_HSIZE - QUERY_ONSCREEN) * 2;
     struct Query_data
     {
 	uint32_t depth_pass[2];
 	uint32_t clustering[2];
+	uint32_t animate_lights[2];
 	uint32_t calc_light_grids[2];
 	uint32_t calc_grid_offsets[2];
 	uint32_t calc_light_list[2];
@@ -444,6 +857,16 @@ private:
 
 	Texel_buffer *p_light_pos_ranges{nullptr};
 	Texel_buffer *p_light_colors{nullptr};
+	Texel_buffer *p_visible_lights{nullptr}; // light indices after frustum culling
+	Texel_buffer *p_light_count_stats{nullptr}; // light cells, max lights per cluster, flagged clusters
+	bool light_count_stats_refined{false}; // refine mode of the frame that wrote them
+	Texel_buffer *p_light_list_feedback{nullptr}; // list total, light node count, light chunk count
+	uint32_t light_list_capacity{0}; // of the frame that wrote them
+	bool light_list_written{false}; // list or nodes, not by the masks and z-bins
+	uint32_t light_chunk_capacity{0};
+	// light blocks not yet written to the buffers above
+	Block_bits light_pos_pending;
+	Block_bits light_color_pending;
 
 	vk::DescriptorSet desc_set;
 
@@ -471,6 +894,16 @@ private:
     vk::PipelineStageFlags compute_wait_stages_;
     vk::PipelineStageFlags onscreen_wait_stages_;
 
+    // lights per flagged cluster of the latest frame with and without
+    // refined light cells, kept both to compare them
+    struct Light_count_stats
+    {
+	uint32_t light_cells{0};
+	uint32_t max_lights{0};
+	uint32_t cluster_count{0};
+	bool valid{false};
+    } light_count_stats_[2];
+
     void init_frame_data_()
     {
 	frame_data_count_=back_buf_count_;
@@ -499,6 +932,10 @@ private:
 	    uint32_t idx=0;
 	    for (auto &data : frame_data_vec_) {
 		// light buffers
+		data.light_pos_pending.resize(Lights::block_count(p_info_->MAX_NUM_LIGHTS));
+		data.light_pos_pending.set_all();
+		data.light_color_pending.resize(Lights::block_count(p_info_->MAX_NUM_LIGHTS));
+		data.light_color_pending.set_all();
 		data.p_light_colors=new Texel_buffer(p_phy_dev_, p_dev_,
 						     host_visible_coherent,
 						     p_info_->MAX_NUM_LIGHTS * 4 * sizeof(char),
@@ -507,11 +944,31 @@ private:
 						     vk::Format::eR8G8B8A8Unorm);
 		data.p_light_pos_ranges=new Texel_buffer(p_phy_dev_, p_dev_,
 							 host_visible_coherent,
-							 p_info_->MAX_NUM_LIGHTS * sizeof(glm::vec4),
+							 p_info_->MAX_NUM_LIGHTS * p_lights_->pos_range_size(),
 							 sharing_mode,
 							 queue_family_count,
 							 p_queue_family,
-							 vk::Format::eR32G32B32A32Sfloat);
+							 p_info_->packed_lights ? vk::Format::eR32G32Uint : vk::Format::eR32G32B32A32Sfloat);
+		data.p_visible_lights=new Texel_buffer(p_phy_dev_, p_dev_,
+						       host_visible_coherent,
+						       p_info_->MAX_NUM_LIGHTS * sizeof(uint32_t),
+						       vk::SharingMode::eExclusive,
+						       0, nullptr,
+						       vk::Format::eR32Uint);
+		data.p_light_count_stats=new Texel_buffer(p_phy_dev_, p_dev_,
+							  host_visible_coherent,
+							  4 * sizeof(uint32_t),
+							  vk::SharingMode::eExclusive,
+							  0, nullptr,
+							  vk::Format::eR32Uint);
+		memset(data.p_light_count_stats->p_buf->mapped, 0, 4 * sizeof(uint32_t));
+		data.p_light_list_feedback=new Texel_buffer(p_phy_dev_, p_dev_,
+							    host_visible_coherent,
+							    3 * sizeof(uint32_t),
+							    vk::SharingMode::eExclusive,
+							    0, nullptr,
+							    vk::Format::eR32Uint);
+		memset(data.p_light_list_feedback->p_buf->mapped, 0, 3 * sizeof(uint32_t));
 
 		// global_uniforms_buffer
 		data.p_global_uniforms=new base::Buffer(p_dev_,
@@ -576,7 +1033,8 @@ private:
 		1, nullptr
 	    };
 
-	    compute_wait_stages_=vk::PipelineStageFlagBits::eComputeShader;
+	    // the active cluster dispatch is read as indirect command
+	    compute_wait_stages_=vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect;
 	    compute_cmd_submit_info_=
 	    {
 		1, nullptr,
@@ -615,6 +1073,9 @@ private:
 	    delete data.p_global_uniforms;
 	    delete data.p_light_pos_ranges;
 	    delete data.p_light_colors;
+	    delete data.p_visible_lights;
+	    delete data.p_light_count_stats;
+	    delete data.p_light_list_feedback;
 	    p_dev_->dev.destroyFence(data.offscreen_cmd_buf_blk.submit_fence);
 	    p_dev_->dev.destroyFence(data.compute_cmd_buf_blk.submit_fence);
 	    p_dev_->dev.destroyFence(data.onscreen_cmd_buf_blk.submit_fence);
@@ -686,6 +1147,14 @@ private:
 	    {
 		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag
 	    };
+	    vk::DescriptorSetLayoutBinding binding_visible_lights=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_light_count_stats=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, comp
+	    };
 	    vk::DescriptorSetLayoutBinding binding_grid_flags=
 	    {
 		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
@@ -714,6 +1183,70 @@ private:
 	    {
 		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
 	    };
+	    vk::DescriptorSetLayoutBinding binding_light_orbits=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_grid_block_sums=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_grid_flag_words=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag
+	    };
+	    vk::DescriptorSetLayoutBinding binding_active_clusters=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_active_cluster_dispatch=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_light_view_spheres=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_light_masks=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_light_depth_keys=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_z_bins=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_tile_light_masks=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_grid_light_heads=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_light_nodes=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, frag_comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_light_chunks=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_light_chunk_dispatch=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_light_chunk_counts=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, comp
+	    };
+	    vk::DescriptorSetLayoutBinding binding_light_chunk_offsets=
+	    {
+		0, vk::DescriptorType::eStorageTexelBuffer, 1, comp
+	    };
 	    vk::DescriptorSetLayoutBinding binding_font_tex=
 	    {
 		0, vk::DescriptorType::eCombinedImageSampler, 1, frag
@@ -725,10 +1258,14 @@ private:
 	    binding_global_uniforms.binding=0;
 	    binding_light_pos_ranges.binding=1;
 	    binding_light_colors.binding=2;
+	    binding_visible_lights.binding=3;
+	    binding_light_count_stats.binding=4;
 
 	    bindings.push_back(binding_global_uniforms);
 	    bindings.push_back(binding_light_pos_ranges);
 	    bindings.push_back(binding_light_colors);
+	    bindings.push_back(binding_visible_lights);
+	    bindings.push_back(binding_light_count_stats);
 	    desc_set_layouts_.frame_data=p_dev_->dev.createDescriptorSetLayout(
 		vk::DescriptorSetLayoutCreateInfo({},
 						  static_cast<uint32_t>(bindings.size()),
@@ -744,6 +1281,22 @@ private:
 	    binding_grid_light_count_offsets.binding=4;
 	    binding_light_list.binding=5;
 	    binding_grid_light_counts_compare.binding=6;
+	    binding_light_orbits.binding=7;
+	    binding_grid_block_sums.binding=8;
+	    binding_grid_flag_words.binding=9;
+	    binding_active_clusters.binding=10;
+	    binding_active_cluster_dispatch.binding=11;
+	    binding_light_view_spheres.binding=12;
+	    binding_light_masks.binding=13;
+	    binding_light_depth_keys.binding=14;
+	    binding_z_bins.binding=15;
+	    binding_tile_light_masks.binding=16;
+	    binding_grid_light_heads.binding=17;
+	    binding_light_nodes.binding=18;
+	    binding_light_chunks.binding=19;
+	    binding_light_chunk_dispatch.binding=20;
+	    binding_light_chunk_counts.binding=21;
+	    binding_light_chunk_offsets.binding=22;
 
 	    bindings.push_back(binding_grid_flags);
 	    bindings.push_back(binding_light_bounds);
@@ -752,6 +1305,22 @@ private:
 	    bindings.push_back(binding_grid_light_count_offsets);
 	    bindings.push_back(binding_light_list);
 	    bindings.push_back(binding_grid_light_counts_compare);
+	    bindings.push_back(binding_light_orbits);
+	    bindings.push_back(binding_grid_block_sums);
+	    bindings.push_back(binding_grid_flag_words);
+	    bindings.push_back(binding_active_clusters);
+	    bindings.push_back(binding_active_cluster_dispatch);
+	    bindings.push_back(binding_light_view_spheres);
+	    bindings.push_back(binding_light_masks);
+	    bindings.push_back(binding_light_depth_keys);
+	    bindings.push_back(binding_z_bins);
+	    bindings.push_back(binding_tile_light_masks);
+	    bindings.push_back(binding_grid_light_heads);
+	    bindings.push_back(binding_light_nodes);
+	    bindings.push_back(binding_light_chunks);
+	    bindings.push_back(binding_light_chunk_dispatch);
+	    bindings.push_back(binding_light_chunk_counts);
+	    bindings.push_back(binding_light_chunk_offsets);
 
 	    desc_set_layouts_.texel_buffers=p_dev_->dev.createDescriptorSetLayout(
 		vk::DescriptorSetLayoutCreateInfo({},
@@ -772,7 +1341,7 @@ private:
 	    std::vector<vk::DescriptorPoolSize> pool_sizes
 	    {
 		vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, frame_data_count_ * 1),
-		vk::DescriptorPoolSize(vk::DescriptorType::eStorageTexelBuffer, frame_data_count_ * 2 + 7),
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageTexelBuffer, frame_data_count_ * 4 + 23),
 		vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1)
 	    };
 
@@ -815,6 +1384,14 @@ private:
 				    2, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
 				    &data.p_light_colors->p_buf->desc_buf_info,
 				    &data.p_light_colors->p_buf->view);
+		writes.emplace_back(data.desc_set,
+				    3, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				    &data.p_visible_lights->p_buf->desc_buf_info,
+				    &data.p_visible_lights->p_buf->view);
+		writes.emplace_back(data.desc_set,
+				    4, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				    &data.p_light_count_stats->p_buf->desc_buf_info,
+				    &data.p_light_count_stats->p_buf->view);
 	    }
 
 	    // texel_buffers
@@ -849,6 +1426,70 @@ private:
 				6, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
 				&p_grid_light_counts_compare_->p_buf->desc_buf_info,
 				&p_grid_light_counts_compare_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				7, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_light_orbits_->p_buf->desc_buf_info,
+				&p_light_orbits_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				8, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_grid_block_sums_->p_buf->desc_buf_info,
+				&p_grid_block_sums_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				9, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_grid_flags_->p_buf->desc_buf_info,
+				&grid_flag_words_view_);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				10, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_active_clusters_->p_buf->desc_buf_info,
+				&p_active_clusters_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				11, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_active_cluster_dispatch_->p_buf->desc_buf_info,
+				&p_active_cluster_dispatch_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				12, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_light_view_spheres_->p_buf->desc_buf_info,
+				&p_light_view_spheres_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				13, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_light_masks_->p_buf->desc_buf_info,
+				&p_light_masks_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				14, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_light_depth_keys_->p_buf->desc_buf_info,
+				&p_light_depth_keys_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				15, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_z_bins_->p_buf->desc_buf_info,
+				&p_z_bins_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				16, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_tile_light_masks_->p_buf->desc_buf_info,
+				&p_tile_light_masks_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				17, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_grid_light_heads_->p_buf->desc_buf_info,
+				&p_grid_light_heads_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				18, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_light_nodes_->p_buf->desc_buf_info,
+				&p_light_nodes_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				19, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_light_chunks_->p_buf->desc_buf_info,
+				&p_light_chunks_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				20, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_light_chunk_dispatch_->p_buf->desc_buf_info,
+				&p_light_chunk_dispatch_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				21, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_light_chunk_counts_->p_buf->desc_buf_info,
+				&p_light_chunk_counts_->p_buf->view);
+	    writes.emplace_back(desc_set_texel_buffers_,
+				22, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				&p_light_chunk_offsets_->p_buf->desc_buf_info,
+				&p_light_chunk_offsets_->p_buf->view);
 
 	    // font tex
 
@@ -881,11 +1522,33 @@ private:
     base::Shader *p_simple_vs_{nullptr};
     base::Shader *p_clustering_vs_{nullptr};
     base::Shader *p_clustering_fs_{nullptr};
+    base::Shader *p_animate_lights_{nullptr};
     base::Shader *p_calc_light_grids_{nullptr};
+    base::Shader *p_calc_light_grids_masks_{nullptr};
+    base::Shader *p_calc_light_grids_z_bins_{nullptr};
+    base::Shader *p_calc_light_grids_linked_lists_{nullptr};
+    base::Shader *p_calc_light_grids_bounds_{nullptr};
+    base::Shader *p_calc_light_grids_chunks_{nullptr};
     base::Shader *p_calc_grid_offsets_{nullptr};
+    base::Shader *p_scan_grid_light_counts_{nullptr};
+    base::Shader *p_add_grid_block_offsets_{nullptr};
+    base::Shader *p_scan_light_chunk_counts_{nullptr};
+    base::Shader *p_add_light_chunk_offsets_{nullptr};
+    base::Shader *p_calc_active_grid_offsets_{nullptr};
+    base::Shader *p_calc_light_count_stats_{nullptr};
     base::Shader *p_calc_light_list_{nullptr};
+    base::Shader *p_sort_light_depths_{nullptr};
+    base::Shader *p_calc_z_bins_{nullptr};
+    base::Shader *p_compact_light_lists_{nullptr};
+    base::Shader *p_calc_cluster_light_counts_{nullptr};
+    base::Shader *p_calc_cluster_light_list_{nullptr};
+    base::Shader *p_calc_light_chunk_counts_{nullptr};
+    base::Shader *p_calc_light_chunk_list_{nullptr};
     base::Shader *p_cluster_forward_vs_{nullptr};
     base::Shader *p_cluster_forward_fs_{nullptr};
+    base::Shader *p_cluster_forward_masks_fs_{nullptr};
+    base::Shader *p_cluster_forward_z_bins_fs_{nullptr};
+    base::Shader *p_cluster_forward_linked_lists_fs_{nullptr};
     base::Shader *p_light_particles_vs_{nullptr};
     base::Shader *p_light_particles_fs_{nullptr};
 
@@ -894,23 +1557,109 @@ private:
 	p_simple_vs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eVertex);
 	p_clustering_vs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eVertex);
 	p_clustering_fs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eFragment);
+	p_animate_lights_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
 	p_calc_light_grids_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_light_grids_masks_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_light_grids_z_bins_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_light_grids_linked_lists_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_light_grids_bounds_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_light_grids_chunks_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
 	p_calc_grid_offsets_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_scan_grid_light_counts_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_add_grid_block_offsets_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_scan_light_chunk_counts_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_add_light_chunk_offsets_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_active_grid_offsets_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_light_count_stats_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
 	p_calc_light_list_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_sort_light_depths_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_z_bins_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_compact_light_lists_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_cluster_light_counts_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_cluster_light_list_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_light_chunk_counts_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+	p_calc_light_chunk_list_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
 	p_cluster_forward_vs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eVertex);
 	p_cluster_forward_fs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eFragment);
+	p_cluster_forward_masks_fs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eFragment);
+	p_cluster_forward_z_bins_fs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eFragment);
+	p_cluster_forward_linked_lists_fs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eFragment);
 	p_light_particles_vs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eVertex);
 	p_light_particles_fs_=new base::Shader(p_dev_, vk::ShaderStageFlagBits::eFragment);
 
 	p_simple_vs_->generate(sizeof(simple_vert), simple_vert);
 	p_clustering_vs_->generate(sizeof(clustering_vert), clustering_vert);
 	p_clustering_fs_->generate(sizeof(clustering_frag), clustering_frag);
-	p_calc_light_grids_->generate(sizeof(calc_light_grids_comp), calc_light_grids_comp);
+	if (p_info_->packed_lights) {
+	    p_animate_lights_->generate(sizeof(animate_lights_packed_comp), animate_lights_packed_comp);
+	    p_calc_light_grids_->generate(sizeof(calc_light_grids_packed_comp), calc_light_grids_packed_comp);
+	    p_calc_light_grids_masks_->generate(sizeof(calc_light_grids_packed_masks_comp), calc_light_grids_packed_masks_comp);
+	    p_calc_light_grids_z_bins_->generate(sizeof(calc_light_grids_packed_z_bins_comp), calc_light_grids_packed_z_bins_comp);
+	    p_calc_light_grids_linked_lists_->generate(sizeof(calc_light_grids_packed_linked_lists_comp), calc_light_grids_packed_linked_lists_comp);
+	    p_calc_light_grids_bounds_->generate(sizeof(calc_light_grids_packed_bounds_comp), calc_light_grids_packed_bounds_comp);
+	    p_calc_light_grids_chunks_->generate(sizeof(calc_light_grids_packed_chunks_comp), calc_light_grids_packed_chunks_comp);
+	}
+	else {
+	    p_animate_lights_->generate(sizeof(animate_lights_comp), animate_lights_comp);
+	    p_calc_light_grids_->generate(sizeof(calc_light_grids_comp), calc_light_grids_comp);
+	    p_calc_light_grids_masks_->generate(sizeof(calc_light_grids_masks_comp), calc_light_grids_masks_comp);
+	    p_calc_light_grids_z_bins_->generate(sizeof(calc_light_grids_z_bins_comp), calc_light_grids_z_bins_comp);
+	    p_calc_light_grids_linked_lists_->generate(sizeof(calc_light_grids_linked_lists_comp), calc_light_grids_linked_lists_comp);
+	    p_calc_light_grids_bounds_->generate(sizeof(calc_light_grids_bounds_comp), calc_light_grids_bounds_comp);
+	    p_calc_light_grids_chunks_->generate(sizeof(calc_light_grids_chunks_comp), calc_light_grids_chunks_comp);
+	}
 	p_calc_grid_offsets_->generate(sizeof(calc_grid_offsets_comp), calc_grid_offsets_comp);
-	p_calc_light_list_->generate(sizeof(calc_light_list_comp), calc_light_list_comp);
+	p_scan_grid_light_counts_->generate(sizeof(scan_grid_light_counts_comp), scan_grid_light_counts_comp);
+	p_add_grid_block_offsets_->generate(sizeof(add_grid_block_offsets_comp), add_grid_block_offsets_comp);
+	p_scan_light_chunk_counts_->generate(sizeof(scan_grid_light_counts_chunks_comp), scan_grid_light_counts_chunks_comp);
+	p_add_light_chunk_offsets_->generate(sizeof(add_grid_block_offsets_chunks_comp), add_grid_block_offsets_chunks_comp);
+	p_calc_active_grid_offsets_->generate(sizeof(calc_active_grid_offsets_comp), calc_active_grid_offsets_comp);
+	p_calc_light_count_stats_->generate(sizeof(calc_light_count_stats_comp), calc_light_count_stats_comp);
+	if (light_indices_16_) {
+	    p_calc_light_list_->generate(sizeof(calc_light_list_indices16_comp), calc_light_list_indices16_comp);
+	}
+	else {
+	    p_calc_light_list_->generate(sizeof(calc_light_list_comp), calc_light_list_comp);
+	}
+	p_sort_light_depths_->generate(sizeof(sort_light_depths_comp), sort_light_depths_comp);
+	p_calc_z_bins_->generate(sizeof(calc_z_bins_comp), calc_z_bins_comp);
+	p_calc_cluster_light_counts_->generate(sizeof(calc_cluster_lights_comp), calc_cluster_lights_comp);
+	p_calc_light_chunk_counts_->generate(sizeof(calc_light_chunks_comp), calc_light_chunks_comp);
+	if (light_indices_16_) {
+	    p_compact_light_lists_->generate(sizeof(compact_light_lists_indices16_comp), compact_light_lists_indices16_comp);
+	    p_calc_cluster_light_list_->generate(sizeof(calc_cluster_lights_list_indices16_comp), calc_cluster_lights_list_indices16_comp);
+	    p_calc_light_chunk_list_->generate(sizeof(calc_light_chunks_list_indices16_comp), calc_light_chunks_list_indices16_comp);
+	}
+	else {
+	    p_compact_light_lists_->generate(sizeof(compact_light_lists_comp), compact_light_lists_comp);
+	    p_calc_cluster_light_list_->generate(sizeof(calc_cluster_lights_list_comp), calc_cluster_lights_list_comp);
+	    p_calc_light_chunk_list_->generate(sizeof(calc_light_chunks_list_comp), calc_light_chunks_list_comp);
+	}
 	p_cluster_forward_vs_->generate(sizeof(cluster_forward_vert), cluster_forward_vert);
-	p_cluster_forward_fs_->generate(sizeof(cluster_forward_frag), cluster_forward_frag);
-	p_light_particles_vs_->generate(sizeof(light_particles_vert), light_particles_vert);
+	if (p_info_->packed_lights) {
+	    if (light_indices_16_) {
+		p_cluster_forward_fs_->generate(sizeof(cluster_forward_packed_indices16_frag), cluster_forward_packed_indices16_frag);
+	    }
+	    else {
+		p_cluster_forward_fs_->generate(sizeof(cluster_forward_packed_frag), cluster_forward_packed_frag);
+	    }
+	    p_cluster_forward_masks_fs_->generate(sizeof(cluster_forward_packed_masks_frag), cluster_forward_packed_masks_frag);
+	    p_cluster_forward_z_bins_fs_->generate(sizeof(cluster_forward_packed_z_bins_frag), cluster_forward_packed_z_bins_frag);
+	    p_cluster_forward_linked_lists_fs_->generate(sizeof(cluster_forward_packed_linked_lists_frag), cluster_forward_packed_linked_lists_frag);
+	    p_light_particles_vs_->generate(sizeof(light_particles_packed_vert), light_particles_packed_vert);
+	}
+	else {
+	    if (light_indices_16_) {
+		p_cluster_forward_fs_->generate(sizeof(cluster_forward_indices16_frag), cluster_forward_indices16_frag);
+	    }
+	    else {
+		p_cluster_forward_fs_->generate(sizeof(cluster_forward_frag), cluster_forward_frag);
+	    }
+	    p_cluster_forward_masks_fs_->generate(sizeof(cluster_forward_masks_frag), cluster_forward_masks_frag);
+	    p_cluster_forward_z_bins_fs_->generate(sizeof(cluster_forward_z_bins_frag), cluster_forward_z_bins_frag);
+	    p_cluster_forward_linked_lists_fs_->generate(sizeof(cluster_forward_linked_lists_frag), cluster_forward_linked_lists_frag);
+	    p_light_particles_vs_->generate(sizeof(light_particles_vert), light_particles_vert);
+	}
 	p_light_particles_fs_->generate(sizeof(light_particles_frag), light_particles_frag);
     }
 
@@ -919,11 +1668,33 @@ private:
 	delete p_simple_vs_;
 	delete p_clustering_vs_;
 	delete p_clustering_fs_;
+	delete p_animate_lights_;
 	delete p_calc_light_grids_;
+	delete p_calc_light_grids_masks_;
+	delete p_calc_light_grids_z_bins_;
+	delete p_calc_light_grids_linked_lists_;
+	delete p_calc_light_grids_bounds_;
+	delete p_calc_light_grids_chunks_;
 	delete p_calc_grid_offsets_;
+	delete p_scan_grid_light_counts_;
+	delete p_add_grid_block_offsets_;
+	delete p_scan_light_chunk_counts_;
+	delete p_add_light_chunk_offsets_;
+	delete p_calc_active_grid_offsets_;
+	delete p_calc_light_count_stats_;
 	delete p_calc_light_list_;
+	delete p_sort_light_depths_;
+	delete p_calc_z_bins_;
+	delete p_compact_light_lists_;
+	delete p_calc_cluster_light_counts_;
+	delete p_calc_cluster_light_list_;
+	delete p_calc_light_chunk_counts_;
+	delete p_calc_light_chunk_list_;
 	delete p_cluster_forward_vs_;
 	delete p_cluster_forward_fs_;
+	delete p_cluster_forward_masks_fs_;
+	delete p_cluster_forward_z_bins_fs_;
+	delete p_cluster_forward_linked_lists_fs_;
 	delete p_light_particles_vs_;
 	delete p_light_particles_fs_;
     }
@@ -1257,11 +2028,36 @@ private:
 	vk::Pipeline depth;
 	vk::Pipeline clustering_opaque;
 	vk::Pipeline clustering_transparent;
+	vk::Pipeline animate_lights;
 	vk::Pipeline calc_light_grids;
+	vk::Pipeline calc_light_grids_masks;
+	vk::Pipeline calc_light_grids_z_bins;
+	vk::Pipeline calc_light_grids_linked_lists;
+	vk::Pipeline calc_light_grids_bounds;
+	vk::Pipeline calc_light_grids_chunks;
 	vk::Pipeline calc_grid_offsets;
+	vk::Pipeline scan_grid_light_counts;
+	vk::Pipeline add_grid_block_offsets;
+	vk::Pipeline scan_light_chunk_counts;
+	vk::Pipeline add_light_chunk_offsets;
+	vk::Pipeline calc_active_grid_offsets;
+	vk::Pipeline calc_light_count_stats;
 	vk::Pipeline calc_light_list;
+	vk::Pipeline sort_light_depths;
+	vk::Pipeline calc_z_bins;
+	vk::Pipeline compact_light_lists;
+	vk::Pipeline calc_cluster_light_counts;
+	vk::Pipeline calc_cluster_light_list;
+	vk::Pipeline calc_light_chunk_counts;
+	vk::Pipeline calc_light_chunk_list;
 	vk::Pipeline cluster_forward_opaque;
 	vk::Pipeline cluster_forward_transparent;
+	vk::Pipeline cluster_forward_masks_opaque;
+	vk::Pipeline cluster_forward_masks_transparent;
+	vk::Pipeline cluster_forward_z_bins_opaque;
+	vk::Pipeline cluster_forward_z_bins_transparent;
+	vk::Pipeline cluster_forward_linked_lists_opaque;
+	vk::Pipeline cluster_forward_linked_lists_transparent;
 	vk::Pipeline light_particles;
 	vk::Pipeline text_overlay;
     } pipelines_;
@@ -1270,6 +2066,7 @@ private:
     {
 	vk::PipelineLayout depth;
 	vk::PipelineLayout clustering;
+	vk::PipelineLayout animate_lights;
 	vk::PipelineLayout calc_light_grids;
 	vk::PipelineLayout calc_grid_offsets;
 	vk::PipelineLayout calc_light_list;
@@ -1281,6 +2078,7 @@ private:
     struct Pipeline_desc_set_ptrs
     {
 	std::vector<vk::DescriptorSet> clustering;
+	std::vector<vk::DescriptorSet> animate_lights;
 	std::vector<vk::DescriptorSet> calc_light_grids;
 	std::vector<vk::DescriptorSet> calc_grid_offsets;
 	std::vector<vk::DescriptorSet> calc_light_list;
@@ -1288,8 +2086,58 @@ private:
 	std::vector<vk::DescriptorSet> light_particles;
     } pipeline_desc_sets_;
 
+    // specialization constants of the clustering and light assignment
+    // shaders, constant_id 0: GRID_DIM_Z, 1: CAM_NEAR, 2: LIGHT_LIST_MAX_LENGTH,
+    // 3, 4: local size x, y of the pipelines in Workgroup_sizes,
+    // 5: LIGHT_CHUNK_CAPACITY
+    struct Grid_constants
+    {
+	uint32_t grid_dim_z;
+	float cam_near;
+	uint32_t light_list_max_length;
+	uint32_t local_size_x;
+	uint32_t local_size_y;
+	uint32_t light_chunk_capacity;
+    };
+
+    enum Grid_constants_use
+    {
+	GRID_CONSTANTS_DEFAULT,
+	GRID_CONSTANTS_ANIMATE_LIGHTS,
+	GRID_CONSTANTS_LIGHT_GRIDS,
+	GRID_CONSTANTS_LIGHT_LIST,
+	GRID_CONSTANTS_GRID_OFFSETS,
+	GRID_CONSTANTS_USE_COUNT
+    };
+
+    Grid_constants grid_constants_[GRID_CONSTANTS_USE_COUNT];
+    vk::SpecializationMapEntry grid_constant_entries_[6];
+    vk::SpecializationInfo grid_constants_info_[GRID_CONSTANTS_USE_COUNT];
+
     void init_pipelines_()
     {
+	// grid constants of the current configuration
+	{
+	    const Workgroup_sizes &sizes=p_info_->workgroup_sizes;
+	    const Grid_constants constants={p_info_->TILE_COUNT_Z, p_camera_->cam_near, p_info_->light_list_capacity, 1, 1, light_chunk_capacity_};
+	    for (auto &c : grid_constants_) c=constants;
+	    grid_constants_[GRID_CONSTANTS_ANIMATE_LIGHTS].local_size_x=sizes.animate_lights;
+	    grid_constants_[GRID_CONSTANTS_LIGHT_GRIDS].local_size_x=sizes.calc_light_grids;
+	    grid_constants_[GRID_CONSTANTS_LIGHT_LIST].local_size_x=sizes.calc_light_list;
+	    grid_constants_[GRID_CONSTANTS_GRID_OFFSETS].local_size_x=sizes.calc_grid_offsets_x;
+	    grid_constants_[GRID_CONSTANTS_GRID_OFFSETS].local_size_y=sizes.calc_grid_offsets_y;
+
+	    grid_constant_entries_[0]=vk::SpecializationMapEntry(0, offsetof(Grid_constants, grid_dim_z), sizeof(uint32_t));
+	    grid_constant_entries_[1]=vk::SpecializationMapEntry(1, offsetof(Grid_constants, cam_near), sizeof(float));
+	    grid_constant_entries_[2]=vk::SpecializationMapEntry(2, offsetof(Grid_constants, light_list_max_length), sizeof(uint32_t));
+	    grid_constant_entries_[3]=vk::SpecializationMapEntry(3, offsetof(Grid_constants, local_size_x), sizeof(uint32_t));
+	    grid_constant_entries_[4]=vk::SpecializationMapEntry(4, offsetof(Grid_constants, local_size_y), sizeof(uint32_t));
+	    grid_constant_entries_[5]=vk::SpecializationMapEntry(5, offsetof(Grid_constants, light_chunk_capacity), sizeof(uint32_t));
+	    for (uint32_t i=0; i < GRID_CONSTANTS_USE_COUNT; i++) {
+		grid_constants_info_[i]=vk::SpecializationInfo(6, grid_constant_entries_, sizeof(Grid_constants), &grid_constants_[i]);
+	    }
+	}
+
 	// pipeline layouts
 	{
 	    // depth
@@ -1360,6 +2208,27 @@ private:
 					     desc_set_layouts.data(),
 					     0, nullptr));
 
+	    // animate lights
+
+	    desc_set_layouts=
+	    {
+		desc_set_layouts_.frame_data, // set on frame
+		desc_set_layouts_.texel_buffers
+	    };
+
+	    pipeline_desc_sets_.animate_lights.resize(desc_set_layouts.size());
+	    pipeline_desc_sets_.animate_lights[1]=desc_set_texel_buffers_;
+
+	    pipeline_layouts_.animate_lights=p_dev_->dev.createPipelineLayout(
+		vk::PipelineLayoutCreateInfo({},
+					     static_cast<uint32_t>(desc_set_layouts.size()),
+					     desc_set_layouts.data(),
+					     0, nullptr));
+
+	    // light count and visible light switch, shared by calc light grids and calc light list
+	    vk::PushConstantRange light_count_push_constant_range(vk::ShaderStageFlagBits::eCompute,
+								  0, sizeof(Light_count_push_constants));
+
 	    // cal light grids
 
 	    desc_set_layouts=
@@ -1375,7 +2244,7 @@ private:
 		vk::PipelineLayoutCreateInfo({},
 					     static_cast<uint32_t>(desc_set_layouts.size()),
 					     desc_set_layouts.data(),
-					     0, nullptr));
+					     1, &light_count_push_constant_range));
 
 	    // cal grid offsets
 
@@ -1409,7 +2278,7 @@ private:
 		vk::PipelineLayoutCreateInfo({},
 					     static_cast<uint32_t>(desc_set_layouts.size()),
 					     desc_set_layouts.data(),
-					     0, nullptr));
+					     1, &light_count_push_constant_range));
 	}
 
 	{
@@ -1510,7 +2379,7 @@ private:
 	    /* clustering */
 
 	    shader_stages[0]=p_clustering_vs_->create_pipeline_stage_info();
-	    shader_stages[1]=p_clustering_fs_->create_pipeline_stage_info();
+	    shader_stages[1]=p_clustering_fs_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]);
 	    pipeline_ci.stageCount=2;
 
 	    color_blend_state.attachmentCount=0;
@@ -1566,7 +2435,7 @@ private:
 	    multisample_state.minSampleShading=0.25;
 
 	    shader_stages[0]=p_cluster_forward_vs_->create_pipeline_stage_info();
-	    shader_stages[1]=p_cluster_forward_fs_->create_pipeline_stage_info();
+	    shader_stages[1]=p_cluster_forward_fs_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]);
 
 	    depth_stencil_state.depthTestEnable=VK_TRUE;
 
@@ -1592,6 +2461,60 @@ private:
 	    pipelines_.cluster_forward_transparent=p_dev_->dev.createGraphicsPipeline(
 		nullptr, pipeline_ci);
 
+	    // light masks, same states
+
+	    shader_stages[1]=p_cluster_forward_masks_fs_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]);
+
+	    rasterization_state.cullMode=vk::CullModeFlagBits::eBack;
+	    blend_attachment_state.blendEnable=VK_FALSE;
+	    depth_stencil_state.depthWriteEnable=VK_TRUE;
+
+	    pipelines_.cluster_forward_masks_opaque=p_dev_->dev.createGraphicsPipeline(
+		nullptr, pipeline_ci);
+
+	    rasterization_state.cullMode=vk::CullModeFlagBits::eNone;
+	    blend_attachment_state.blendEnable=VK_TRUE;
+	    depth_stencil_state.depthWriteEnable=VK_FALSE;
+
+	    pipelines_.cluster_forward_masks_transparent=p_dev_->dev.createGraphicsPipeline(
+		nullptr, pipeline_ci);
+
+	    // z-bins, same states
+
+	    shader_stages[1]=p_cluster_forward_z_bins_fs_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]);
+
+	    rasterization_state.cullMode=vk::CullModeFlagBits::eBack;
+	    blend_attachment_state.blendEnable=VK_FALSE;
+	    depth_stencil_state.depthWriteEnable=VK_TRUE;
+
+	    pipelines_.cluster_forward_z_bins_opaque=p_dev_->dev.createGraphicsPipeline(
+		nullptr, pipeline_ci);
+
+	    rasterization_state.cullMode=vk::CullModeFlagBits::eNone;
+	    blend_attachment_state.blendEnable=VK_TRUE;
+	    depth_stencil_state.depthWriteEnable=VK_FALSE;
+
+	    pipelines_.cluster_forward_z_bins_transparent=p_dev_->dev.createGraphicsPipeline(
+		nullptr, pipeline_ci);
+
+	    // linked lists, same states
+
+	    shader_stages[1]=p_cluster_forward_linked_lists_fs_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]);
+
+	    rasterization_state.cullMode=vk::CullModeFlagBits::eBack;
+	    blend_attachment_state.blendEnable=VK_FALSE;
+	    depth_stencil_state.depthWriteEnable=VK_TRUE;
+
+	    pipelines_.cluster_forward_linked_lists_opaque=p_dev_->dev.createGraphicsPipeline(
+		nullptr, pipeline_ci);
+
+	    rasterization_state.cullMode=vk::CullModeFlagBits::eNone;
+	    blend_attachment_state.blendEnable=VK_TRUE;
+	    depth_stencil_state.depthWriteEnable=VK_FALSE;
+
+	    pipelines_.cluster_forward_linked_lists_transparent=p_dev_->dev.createGraphicsPipeline(
+		nullptr, pipeline_ci);
+
 	    /* light particles */
 
 	    input_assembly_state.topology=vk::PrimitiveTopology::ePointList;
@@ -1604,11 +2527,11 @@ private:
 	    shader_stages[1]=p_light_particles_fs_->create_pipeline_stage_info();
 
 	    std::vector<vk::VertexInputBindingDescription> vi_bindings={
-		vk::VertexInputBindingDescription(0, 4 * sizeof(float), vk::VertexInputRate::eVertex),
+		vk::VertexInputBindingDescription(0, p_lights_->pos_range_size(), vk::VertexInputRate::eVertex),
 		vk::VertexInputBindingDescription(1, 4 * sizeof(char), vk::VertexInputRate::eVertex)
 	    };
 	    std::vector<vk::VertexInputAttributeDescription> vi_attribs={
-		vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32A32Sfloat, 0),
+		vk::VertexInputAttributeDescription(0, 0, light_pos_range_format_(), 0),
 		vk::VertexInputAttributeDescription(1, 1, vk::Format::eR8G8B8A8Unorm, 0)
 	    };
 	    vertex_input_state.vertexBindingDescriptionCount=static_cast<uint32_t>(vi_bindings.size());
@@ -1641,19 +2564,118 @@ private:
 
 	    /* compute */
 
+	    pipelines_.animate_lights=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_animate_lights_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_ANIMATE_LIGHTS]),
+						       pipeline_layouts_.animate_lights));
+
 	    pipelines_.calc_light_grids=p_dev_->dev.createComputePipeline(
 		nullptr, vk::ComputePipelineCreateInfo({},
-						       p_calc_light_grids_->create_pipeline_stage_info(),
+						       p_calc_light_grids_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_LIGHT_GRIDS]),
+						       pipeline_layouts_.calc_light_grids));
+
+	    pipelines_.calc_light_grids_masks=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_light_grids_masks_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_LIGHT_GRIDS]),
+						       pipeline_layouts_.calc_light_grids));
+
+	    pipelines_.calc_light_grids_z_bins=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_light_grids_z_bins_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_LIGHT_GRIDS]),
+						       pipeline_layouts_.calc_light_grids));
+
+	    pipelines_.calc_light_grids_linked_lists=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_light_grids_linked_lists_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_LIGHT_GRIDS]),
+						       pipeline_layouts_.calc_light_grids));
+
+	    pipelines_.calc_light_grids_bounds=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_light_grids_bounds_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_LIGHT_GRIDS]),
+						       pipeline_layouts_.calc_light_grids));
+
+	    pipelines_.calc_light_grids_chunks=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_light_grids_chunks_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_LIGHT_GRIDS]),
 						       pipeline_layouts_.calc_light_grids));
 
 	    pipelines_.calc_grid_offsets=p_dev_->dev.createComputePipeline(
 		nullptr, vk::ComputePipelineCreateInfo({},
-						       p_calc_grid_offsets_->create_pipeline_stage_info(),
+						       p_calc_grid_offsets_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_GRID_OFFSETS]),
+						       pipeline_layouts_.calc_grid_offsets));
+
+	    // the scan, active cluster, stats and compaction passes share the calc grid offsets layout
+	    pipelines_.scan_grid_light_counts=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_scan_grid_light_counts_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
+						       pipeline_layouts_.calc_grid_offsets));
+
+	    pipelines_.add_grid_block_offsets=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_add_grid_block_offsets_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
+						       pipeline_layouts_.calc_grid_offsets));
+
+	    pipelines_.calc_active_grid_offsets=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_active_grid_offsets_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
+						       pipeline_layouts_.calc_grid_offsets));
+
+	    pipelines_.calc_light_count_stats=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_light_count_stats_->create_pipeline_stage_info(),
+						       pipeline_layouts_.calc_grid_offsets));
+
+	    pipelines_.compact_light_lists=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_compact_light_lists_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
 						       pipeline_layouts_.calc_grid_offsets));
 
 	    pipelines_.calc_light_list=p_dev_->dev.createComputePipeline(
 		nullptr, vk::ComputePipelineCreateInfo({},
-						       p_calc_light_list_->create_pipeline_stage_info(),
+						       p_calc_light_list_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_LIGHT_LIST]),
+						       pipeline_layouts_.calc_light_list));
+
+	    // the z-bin passes take the light count like calc light list
+	    pipelines_.sort_light_depths=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_sort_light_depths_->create_pipeline_stage_info(),
+						       pipeline_layouts_.calc_light_list));
+
+	    pipelines_.calc_z_bins=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_z_bins_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_LIGHT_LIST]),
+						       pipeline_layouts_.calc_light_list));
+
+	    // so do the cluster parallel and chunked light cells
+	    pipelines_.calc_cluster_light_counts=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_cluster_light_counts_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
+						       pipeline_layouts_.calc_light_list));
+
+	    pipelines_.calc_cluster_light_list=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_cluster_light_list_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
+						       pipeline_layouts_.calc_light_list));
+
+	    // the chunk count scan takes the light count push constants
+	    pipelines_.scan_light_chunk_counts=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_scan_light_chunk_counts_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
+						       pipeline_layouts_.calc_light_list));
+
+	    pipelines_.add_light_chunk_offsets=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_add_light_chunk_offsets_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
+						       pipeline_layouts_.calc_light_list));
+
+	    pipelines_.calc_light_chunk_counts=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_light_chunk_counts_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
+						       pipeline_layouts_.calc_light_list));
+
+	    pipelines_.calc_light_chunk_list=p_dev_->dev.createComputePipeline(
+		nullptr, vk::ComputePipelineCreateInfo({},
+						       p_calc_light_chunk_list_->create_pipeline_stage_info(&grid_constants_info_[GRID_CONSTANTS_DEFAULT]),
 						       pipeline_layouts_.calc_light_list));
 
 	}
@@ -1663,6 +2685,7 @@ private:
     {
 	p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.depth);
 	p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.clustering);
+	p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.animate_lights);
 	p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.calc_light_grids);
 	p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.calc_grid_offsets);
 	p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.calc_light_list);
@@ -1673,11 +2696,36 @@ private:
 	p_dev_->dev.destroyPipeline(pipelines_.clustering_opaque);
 	p_dev_->dev.destroyPipeline(pipelines_.clustering_transparent);
 	p_dev_->dev.destroyPipeline(pipelines_.light_particles);
+	p_dev_->dev.destroyPipeline(pipelines_.animate_lights);
 	p_dev_->dev.destroyPipeline(pipelines_.calc_light_grids);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_light_grids_masks);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_light_grids_z_bins);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_light_grids_linked_lists);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_light_grids_bounds);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_light_grids_chunks);
 	p_dev_->dev.destroyPipeline(pipelines_.calc_grid_offsets);
+	p_dev_->dev.destroyPipeline(pipelines_.scan_grid_light_counts);
+	p_dev_->dev.destroyPipeline(pipelines_.add_grid_block_offsets);
+	p_dev_->dev.destroyPipeline(pipelines_.scan_light_chunk_counts);
+	p_dev_->dev.destroyPipeline(pipelines_.add_light_chunk_offsets);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_active_grid_offsets);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_light_count_stats);
 	p_dev_->dev.destroyPipeline(pipelines_.calc_light_list);
+	p_dev_->dev.destroyPipeline(pipelines_.sort_light_depths);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_z_bins);
+	p_dev_->dev.destroyPipeline(pipelines_.compact_light_lists);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_cluster_light_counts);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_cluster_light_list);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_light_chunk_counts);
+	p_dev_->dev.destroyPipeline(pipelines_.calc_light_chunk_list);
 	p_dev_->dev.destroyPipeline(pipelines_.cluster_forward_opaque);
 	p_dev_->dev.destroyPipeline(pipelines_.cluster_forward_transparent);
+	p_dev_->dev.destroyPipeline(pipelines_.cluster_forward_masks_opaque);
+	p_dev_->dev.destroyPipeline(pipelines_.cluster_forward_masks_transparent);
+	p_dev_->dev.destroyPipeline(pipelines_.cluster_forward_z_bins_opaque);
+	p_dev_->dev.destroyPipeline(pipelines_.cluster_forward_z_bins_transparent);
+	p_dev_->dev.destroyPipeline(pipelines_.cluster_forward_linked_lists_opaque);
+	p_dev_->dev.destroyPipeline(pipelines_.cluster_forward_linked_lists_transparent);
 	p_dev_->dev.destroyPipeline(pipelines_.text_overlay);
     }
 
@@ -1685,7 +2733,7 @@ private:
     // on frame
     // ************************************************************************
 
-    void update_global_uniforms_(Frame_data &data)
+    void update_global_uniforms_(float light_time, Frame_data &data)
     {
 	/*
 	glm::mat4 view;
@@ -1701,6 +2749,10 @@ private:
 
 	glm::vec2 resolution;
 	uint32_t num_lights;
+	float time;
+
+	glm::vec4 light_pos_min;
+	glm::vec4 light_pos_extent;
 	*/
 
 	// update host data
@@ -1720,35 +2772,281 @@ private:
 	global_uniforms_.resolution[0]=static_cast<float>(p_info_->width());
 	global_uniforms_.resolution[1]=static_cast<float>(p_info_->height());
 	global_uniforms_.num_lights=p_info_->num_lights;
+	global_uniforms_.time=light_time;
+
+	global_uniforms_.light_pos_min=glm::vec4(light_pos_min_, 0.f);
+	global_uniforms_.light_pos_extent=glm::vec4(light_pos_extent_, p_lights_->packing_error());
 
 	// memcpy to host visible memory
 	auto mapped=reinterpret_cast<Global_uniforms *>(data.p_global_uniforms->mapped);
 	memcpy(mapped, &global_uniforms_, sizeof(Global_uniforms));
     }
 
-    void update_light_buffers_(float elapsed_time, Frame_data &data)
+    // the compute work of the frame data is done, calc_light_count_stats.comp
+    // accumulates into zeroed stats
+    void read_light_count_stats_(Frame_data &data)
+    {
+	auto *p_stats=reinterpret_cast<uint32_t *>(data.p_light_count_stats->p_buf->mapped);
+	if (p_stats[2]) {
+	    auto &stats=light_count_stats_[data.light_count_stats_refined ? 1 : 0];
+	    stats.light_cells=p_stats[0];
+	    stats.max_lights=p_stats[1];
+	    stats.cluster_count=p_stats[2];
+	    stats.valid=true;
+	}
+	memset(p_stats, 0, 4 * sizeof(uint32_t));
+    }
+
+    // ************************************************************************
+    // light list capacity
+    // ************************************************************************
+
+    // the demand of a frame, the list total or the light node count, comes
+    // back a frame data cycle later. the list grows to twice the demand past
+    // 3/4 of the capacity and shrinks to twice the peak demand after
+    // LIGHT_LIST_SHRINK_FRAMES frames below 1/4. the masks and z-bins leave
+    // the list alone and read back 0, their frames don't count towards the
+    // shrink. clusters that don't fit the capacity entirely lose their lights
+    // until the list has grown, the demand keeps counting them so those
+    // frames are counted
+    static constexpr uint32_t LIGHT_LIST_SHRINK_FRAMES=300;
+
+    struct Light_list_feedback
+    {
+	uint32_t demand{0}; // of the latest frame read back
+	uint32_t overflow_frames{0};
+	uint32_t low_frames{0}; // in a row below 1/4 of the capacity
+	uint32_t low_peak_demand{0}; // during them
+    } light_list_feedback_;
+    bool light_list_resized_{false};
+
+    // the chunks of the balanced lists come back with the list demand.
+    // light_chunks grows to twice the demand past 3/4 of the capacity, the
+    // chunks past it are left out until then, those frames are counted
+    static constexpr uint32_t LIGHT_CHUNK_MIN_CAPACITY=256 * 1024;
+
+    struct Light_chunk_feedback
+    {
+	uint32_t demand{0}; // of the latest frame read back
+	uint32_t overflow_frames{0};
+    } light_chunk_feedback_;
+    uint32_t light_chunk_capacity_{LIGHT_CHUNK_MIN_CAPACITY};
+
+    // r16ui light indices in light_list while every light index fits, half
+    // the list memory and the index fetches of cluster_forward.frag. storage
+    // texel buffer support of r16ui is optional
+    static constexpr uint32_t MAX_LIGHT_INDEX_16_LIGHTS=65536;
+    bool light_indices_16_supported_{false};
+    bool light_indices_16_{false}; // of the list buffer and the shaders
+
+    void init_light_index_format_()
+    {
+	const vk::FormatProperties props=p_phy_dev_->phy_dev.getFormatProperties(vk::Format::eR16Uint);
+	light_indices_16_supported_=static_cast<bool>(props.bufferFeatures & vk::FormatFeatureFlagBits::eStorageTexelBuffer);
+	light_indices_16_=use_light_indices_16_();
+    }
+
+    bool use_light_indices_16_() const
+    {
+	return light_indices_16_supported_ && p_info_->compact_light_indices &&
+	    p_info_->num_lights <= MAX_LIGHT_INDEX_16_LIGHTS;
+    }
+
+    // power of two >= 2 * demand within the capacity limits
+    uint32_t light_list_capacity_for_(uint32_t demand) const
+    {
+	const uint32_t max_capacity=std::min(p_info_->LIGHT_LIST_MAX_CAPACITY,
+					     p_phy_dev_->props.limits.maxTexelBufferElements / 2 - 1); // light nodes
+	uint64_t capacity=p_info_->LIGHT_LIST_MIN_CAPACITY;
+	while (capacity < 2ull * demand && capacity < max_capacity) capacity*=2;
+	return static_cast<uint32_t>(std::min<uint64_t>(capacity, max_capacity));
+    }
+
+    // the onscreen work of the frame data is done, its transfer pass copied
+    // the demand
+    void read_light_list_feedback_(Frame_data &data)
+    {
+	auto *p_feedback=reinterpret_cast<uint32_t *>(data.p_light_list_feedback->p_buf->mapped);
+	auto &f=light_list_feedback_;
+	f.demand=std::max(p_feedback[0], p_feedback[1]);
+	light_chunk_feedback_.demand=p_feedback[2];
+	memset(p_feedback, 0, 3 * sizeof(uint32_t));
+	if (f.demand > data.light_list_capacity) f.overflow_frames++;
+	read_light_chunk_feedback_(data);
+
+	const uint32_t capacity=p_info_->light_list_capacity;
+	uint32_t new_capacity=capacity;
+	if (f.demand > capacity / 4 * 3) {
+	    new_capacity=std::max(capacity, light_list_capacity_for_(f.demand));
+	    f.low_frames=0;
+	}
+	else if (f.demand < capacity / 4 && data.light_list_written) {
+	    f.low_peak_demand=f.low_frames ? std::max(f.low_peak_demand, f.demand) : f.demand;
+	    if (++f.low_frames >= LIGHT_LIST_SHRINK_FRAMES) {
+		new_capacity=light_list_capacity_for_(f.low_peak_demand);
+		f.low_frames=0;
+	    }
+	}
+	else {
+	    f.low_frames=0;
+	}
+	if (new_capacity != capacity) {
+	    p_info_->light_list_capacity=new_capacity;
+	    light_list_resized_=true;
+	}
+    }
+
+    void read_light_chunk_feedback_(const Frame_data &data)
+    {
+	auto &f=light_chunk_feedback_;
+	if (f.demand > data.light_chunk_capacity) f.overflow_frames++;
+	if (f.demand > light_chunk_capacity_ / 4 * 3) {
+	    const uint32_t max_capacity=p_phy_dev_->props.limits.maxTexelBufferElements / 2;
+	    uint64_t capacity=light_chunk_capacity_;
+	    while (capacity < 2ull * f.demand && capacity < max_capacity) capacity*=2;
+	    capacity=std::min<uint64_t>(capacity, max_capacity);
+	    if (capacity != light_chunk_capacity_) {
+		light_chunk_capacity_=static_cast<uint32_t>(capacity);
+		light_list_resized_=true;
+	    }
+	}
+    }
+
+    // a new capacity or light index format takes new list buffers,
+    // descriptors and pipelines, the frames record their command buffers
+    // again anyway. the light count crosses MAX_LIGHT_INDEX_16_LIGHTS between
+    // frames
+    void detect_light_list_resize_()
+    {
+	const bool light_indices_16=use_light_indices_16_();
+	const bool format_changed=light_indices_16 != light_indices_16_;
+	if (light_list_resized_ || format_changed) {
+	    light_list_resized_=false;
+	    light_indices_16_=light_indices_16;
+	    p_dev_->dev.waitIdle();
+	    delete p_light_list_;
+	    delete p_light_nodes_;
+	    delete p_light_chunks_;
+	    init_light_list_buffers_();
+
+	    const vk::WriteDescriptorSet writes[3]={
+		vk::WriteDescriptorSet(desc_set_texel_buffers_,
+				       5, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				       &p_light_list_->p_buf->desc_buf_info,
+				       &p_light_list_->p_buf->view),
+		vk::WriteDescriptorSet(desc_set_texel_buffers_,
+				       18, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				       &p_light_nodes_->p_buf->desc_buf_info,
+				       &p_light_nodes_->p_buf->view),
+		vk::WriteDescriptorSet(desc_set_texel_buffers_,
+				       19, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+				       &p_light_chunks_->p_buf->desc_buf_info,
+				       &p_light_chunks_->p_buf->view)
+	    };
+	    p_dev_->dev.updateDescriptorSets(3, writes, 0, nullptr);
+	    if (format_changed) {
+		// the shaders that access light_list declare its format
+		destroy_shaders_();
+		init_shaders_();
+	    }
+
+	    assignment_buffers_cleared_=false; // the node count
+	    grid_constants_changed_=true;
+	}
+    }
+
+    // the light masks only take memory once they are used, and grow to the
+    // words of the grid and light count, at most MAX_MASK_LIGHTS bits per
+    // cluster
+    static constexpr uint32_t LIGHT_MASK_MIN_CAPACITY=64 * 1024;
+    uint32_t light_mask_capacity_{LIGHT_MASK_MIN_CAPACITY};
+
+    void detect_light_mask_resize_()
+    {
+	if (p_info_->used_light_assignment() != LIGHT_ASSIGNMENT_MASKS) return;
+	const uint32_t grid_count=p_info_->tile_count_x * p_info_->tile_count_y * p_info_->TILE_COUNT_Z;
+	const uint32_t words=grid_count * ((p_info_->num_lights + 31) / 32);
+	if (words <= light_mask_capacity_) return;
+
+	light_mask_capacity_=words;
+	p_dev_->dev.waitIdle();
+	delete p_light_masks_;
+	init_light_mask_buffer_();
+	const vk::WriteDescriptorSet write(desc_set_texel_buffers_,
+					   13, 0, 1, vk::DescriptorType::eStorageTexelBuffer, nullptr,
+					   &p_light_masks_->p_buf->desc_buf_info,
+					   &p_light_masks_->p_buf->view);
+	p_dev_->dev.updateDescriptorSets(1, &write, 0, nullptr);
+	assignment_buffers_cleared_=false; // the new masks
+    }
+
+    void update_light_buffers_(float light_time, Frame_data &data)
     {
 	if (p_info_->gen_lights) {
 	    generate_lights();
 	    p_info_->gen_lights=false;
 	}
+	if (p_info_->resize_lights) {
+	    resize_lights();
+	    p_info_->resize_lights=false;
+	}
+	if (p_info_->light_sort_interval && ++frames_since_light_sort_ >= p_info_->light_sort_interval) {
+	    sort_lights(light_time);
+	    frames_since_light_sort_=0;
+	}
 
-	// update host data
-	for (auto i=0; i < p_info_->num_lights; i++) {
-	    lights_[i].update(elapsed_time);
-	    glm::vec4 tmp={lights_[i].position, lights_[i].range};
-	    memcpy(p_light_position_ranges_ + i * 4, glm::value_ptr(tmp), 4 * sizeof(float));
-	    memcpy(p_light_colors_ + i * 4, glm::value_ptr(lights_[i].color), 4 * sizeof(char));
+	const bool gpu_animation=p_info_->gpu_light_animation;
+	if (gpu_animation) {
+	    // positions are written by the animate lights pass
+	    if (light_orbits_valid_count_ < p_lights_->size()) upload_light_orbits_();
 	}
+	else {
+	    // the host copy is stale after gpu animation
+	    if (light_pos_from_gpu_) p_lights_->mark_all_dirty();
+	    p_lights_->update(light_time, p_info_->num_lights);
+	}
+	light_pos_from_gpu_=gpu_animation;
 
-	// memcpy to host visible memory
-	{
-	    auto mapped=reinterpret_cast<float *>(data.p_light_pos_ranges->p_buf->mapped);
-	    memcpy(mapped, p_light_position_ranges_, 4 * sizeof(float) * p_info_->num_lights);
+	// every frame data slot has to see each change once
+	for (auto &d : frame_data_vec_) {
+	    d.light_pos_pending.merge(p_lights_->pos_dirty());
+	    d.light_color_pending.merge(p_lights_->color_dirty());
 	}
-	{
-	    auto mapped=reinterpret_cast<char *>(data.p_light_colors->p_buf->mapped);
-	    memcpy(mapped, p_light_colors_, 4 * sizeof(char) * p_info_->num_lights);
+	p_lights_->clear_dirty();
+
+	// only the changed 4 KB pages are written into host visible memory
+	const uint32_t num_lights=p_info_->num_lights;
+	const uint32_t block_count=Lights::block_count(num_lights);
+	light_upload_bytes_=0;
+	if (!gpu_animation) {
+	    data.light_pos_pending.for_each_run(block_count, [&](uint32_t begin_block, uint32_t end_block) {
+		uint32_t begin=begin_block * Lights::BLOCK_SIZE;
+		uint32_t end=std::min(end_block * Lights::BLOCK_SIZE, num_lights);
+		p_lights_->write_pos_ranges(begin, end, data.p_light_pos_ranges->p_buf->mapped);
+		light_upload_bytes_+=(end - begin) * p_lights_->pos_range_size();
+	    });
+	    data.light_pos_pending.clear();
+	}
+	data.light_color_pending.for_each_run(block_count, [&](uint32_t begin_block, uint32_t end_block) {
+	    uint32_t begin=begin_block * Lights::BLOCK_SIZE;
+	    uint32_t end=std::min(end_block * Lights::BLOCK_SIZE, num_lights);
+	    p_lights_->write_colors(begin, end, data.p_light_colors->p_buf->mapped);
+	    light_upload_bytes_+=(end - begin) * sizeof(uint32_t);
+	});
+	data.light_color_pending.clear();
+
+	// the compute passes only walk the lights that touch the frustum, the
+	// host positions are stale in gpu animation mode
+	lights_culled_=p_info_->cpu_light_culling && !gpu_animation;
+	visible_light_count_=num_lights;
+	if (lights_culled_) {
+	    base::Timer timer;
+	    glm::vec4 planes[base::FRUSTUM_PLANE_COUNT];
+	    p_camera_->get_frustum_planes(planes);
+	    visible_light_count_=p_lights_->cull(*p_thread_pool_, planes, num_lights,
+						 reinterpret_cast<uint32_t *>(data.p_visible_lights->p_buf->mapped));
+	    light_upload_bytes_+=visible_light_count_ * sizeof(uint32_t);
+	    light_cull_ms_=static_cast<float>(timer.get() * 1000.0);
 	}
     }
 
@@ -1760,6 +3058,9 @@ private:
 	p_dev_->dev.resetFences(1, &back.present_queue_submit_fence);
 
 	detect_window_resize_();
+	detect_light_list_resize_();
+	detect_light_mask_resize_();
+	detect_grid_constants_change_();
 
 	vk::Result res=vk::Result::eTimeout;
 	while (res != vk::Result::eSuccess) {
@@ -1805,6 +3106,18 @@ private:
 	}
     }
 
+    // new grid constants or workgroup sizes take new pipelines, the frames record their
+    // command buffers again anyway
+    void detect_grid_constants_change_()
+    {
+	if (grid_constants_changed_) {
+	    grid_constants_changed_=false;
+	    p_dev_->dev.waitIdle();
+	    destroy_pipelines_();
+	    init_pipelines_();
+	}
+    }
+
     base::FPS_log text_overlay_update_counter_{60};
     std::string text_overlay_content_;
 
@@ -1813,40 +3126,170 @@ private:
 	std::stringstream ss;
 	uint32_t depth=data.query_data.depth_pass[1] - data.query_data.depth_pass[0];
 	uint32_t clustering=data.query_data.clustering[1] - data.query_data.clustering[0];
+	uint32_t animate=data.query_data.animate_lights[1] - data.query_data.animate_lights[0];
 	uint32_t compute_flags=data.query_data.calc_light_grids[1] - data.query_data.calc_light_grids[0];
 	uint32_t compute_offsets=data.query_data.calc_grid_offsets[1] - data.query_data.calc_grid_offsets[0];
 	uint32_t compute_list=data.query_data.calc_light_list[1] - data.query_data.calc_light_list[0];
 	uint32_t onscreen=data.query_data.onscreen[1] - data.query_data.onscreen[0];
 	uint32_t transfer=data.query_data.transfer[1] - data.query_data.transfer[0];
+	static const char *grid_offsets_mode_strs[GRID_OFFSETS_MODE_COUNT]={"prefix sum", "atomic", "atomic, active clusters"};
+	// the z-bin and linked list passes are timed with the queries of the grid passes
+	static const char *grid_pass_strs[3]={"calc light grids: ", "calc grid offsets: ", "calc light list: "};
+	static const char *z_bin_pass_strs[3]={"calc light bounds: ", "sort lights by depth: ", "calc z-bins, tile masks: "};
+	static const char *linked_list_pass_strs[3]={"calc linked lists: ", "calc grid offsets: ", "compact light lists: "};
+	static const char *cluster_pass_strs[3]={"calc light bounds, cluster counts: ", "calc grid offsets: ", "calc cluster light lists: "};
+	static const char *chunk_pass_strs[3]={"calc light chunks, counts: ", "calc grid offsets: ", "calc light list from chunks: "};
+	const char *const *pass_strs=grid_pass_strs;
+	if (light_assignment_used_ == LIGHT_ASSIGNMENT_Z_BINS) pass_strs=z_bin_pass_strs;
+	else if (light_assignment_used_ == LIGHT_ASSIGNMENT_LINKED_LISTS ||
+		 light_assignment_used_ == LIGHT_ASSIGNMENT_COMPACTED_LISTS) pass_strs=linked_list_pass_strs;
+	else if (light_assignment_used_ == LIGHT_ASSIGNMENT_CLUSTER_LISTS) pass_strs=cluster_pass_strs;
+	else if (light_assignment_used_ == LIGHT_ASSIGNMENT_BALANCED_LISTS) pass_strs=chunk_pass_strs;
+	std::stringstream light_assignment;
+	light_assignment << light_assignment_str(p_info_->light_assignment);
+	if (p_info_->used_light_assignment() != p_info_->light_assignment) {
+	    light_assignment << ", list above " <<
+		(p_info_->light_assignment == LIGHT_ASSIGNMENT_MASKS ? p_info_->MAX_MASK_LIGHTS : p_info_->MAX_Z_BIN_LIGHTS) << " lights";
+	}
+	std::stringstream light_cells[2];
+	for (uint32_t i=0; i < 2; i++) {
+	    const auto &stats=light_count_stats_[i];
+	    if (stats.valid) {
+		light_cells[i] << std::fixed << std::setprecision(1) <<
+		    static_cast<float>(stats.light_cells) / stats.cluster_count << " avg, " << stats.max_lights << " max";
+	    }
+	    else {
+		light_cells[i] << "n/a";
+	    }
+	}
+	std::stringstream light_culling;
+	if (lights_culled_) {
+	    light_culling << visible_light_count_ << " / " << p_info_->num_lights << " visible (" <<
+		static_cast<int>(100.f * visible_light_count_ / std::max(1u, p_info_->num_lights)) << "%), " <<
+		std::fixed << std::setprecision(2) << light_cull_ms_ << " ms";
+	}
+	else {
+	    light_culling << (p_info_->cpu_light_culling ? "n/a with GPU animation" : "off");
+	}
+	std::stringstream workgroup_sizes;
+	workgroup_sizes << "animate " << p_info_->workgroup_sizes.animate_lights <<
+	    ", grids " << p_info_->workgroup_sizes.calc_light_grids <<
+	    ", list " << p_info_->workgroup_sizes.calc_light_list <<
+	    ", offsets " << p_info_->workgroup_sizes.calc_grid_offsets_x << "x" << p_info_->workgroup_sizes.calc_grid_offsets_y;
+	if (p_info_->tune_workgroup_sizes && p_workgroup_tune_->round_count()) {
+	    workgroup_sizes << ", tuning " << p_workgroup_tune_->round() << " / " << p_workgroup_tune_->round_count();
+	}
+	std::stringstream light_sort;
+	if (p_info_->light_sort_interval) {
+	    light_sort << "every " << p_info_->light_sort_interval << " frames, " <<
+		std::fixed << std::setprecision(2) << light_sort_ms_ << " ms";
+	}
+	else {
+	    light_sort << "off";
+	}
 	ss << p_phy_dev_->props.deviceName << "\n" <<
 	    "resolution: " << std::to_string(p_info_->width()) << "x" << std::to_string(p_info_->height()) << "\n" <<
 	    "light count: " << std::to_string(p_info_->num_lights) << "\n" <<
-	    "grid dimension: " << p_info_->tile_count_x << " * " << p_info_->tile_count_y << " * " << p_info_->TILE_COUNT_Z << "\n" <<
+	    "light animation: " << (p_info_->gpu_light_animation ? "GPU" : base::simd_level_str(p_lights_->simd_level())) << "\n" <<
+	    "animated lights: " << static_cast<int>(p_info_->animated_light_fraction * 100.f) << "%" << (p_info_->pause_light_animation ? " (paused)" : "") << "\n" <<
+	    "light format: " << (p_info_->packed_lights ? "packed 8 B" : "rgba32f 16 B") << "\n" <<
+	    "light upload: " << light_upload_bytes_ / 1024 << " KB/frame\n" <<
+	    "light sort: " << light_sort.str() << "\n" <<
+	    "light culling: " << light_culling.str() << "\n" <<
+	    "light resize: " << (p_info_->incremental_light_resize ? (p_info_->rescale_light_ranges ? "incremental, rescale ranges" : "incremental") : "regenerate") << "\n" <<
+	    "grid offsets: " << grid_offsets_mode_strs[p_info_->grid_offsets_mode] << "\n" <<
+	    "light assignment: " << light_assignment.str() << "\n" <<
+	    "light cells: " << (p_info_->refine_light_cells ? "refined to spheres" : "bounding boxes") << "\n" <<
+	    "lights per cluster, boxes: " << light_cells[0].str() << "\n" <<
+	    "lights per cluster, refined: " << light_cells[1].str() << "\n" <<
+	    "grid dimension: " << p_info_->tile_count_x << " * " << p_info_->tile_count_y << " * " << p_info_->TILE_COUNT_Z <<
+	    " (" << p_info_->TILE_WIDTH << "x" << p_info_->TILE_HEIGHT << " px tiles)\n" <<
+	    "light list: " << light_list_feedback_.demand << " / " << p_info_->light_list_capacity <<
+	    (light_indices_16_ ? " 16 bit" : " 32 bit") << " entries, " <<
+	    light_list_feedback_.overflow_frames << " frames overflowed\n" <<
+	    "light chunks: " << light_chunk_feedback_.demand << " / " << light_chunk_capacity_ << ", " <<
+	    light_chunk_feedback_.overflow_frames << " frames overflowed\n" <<
+	    "camera path: " << p_autotune_->camera_path_str() << "\n" <<
+	    "workgroup sizes: " << workgroup_sizes.str() << "\n" <<
 	    "CPU: " << text_overlay_update_counter_.get_fps() << " fps\n\n" <<
 	    "query data (in ms)\n" <<
 	    "------------------\n" <<
 	    "subpass depth: " << timestamp_to_str(depth) << "\n" <<
 	    "subpass clustering: " << timestamp_to_str(clustering) << "\n" <<
-	    "calc light grids: " << timestamp_to_str(compute_flags) << "\n" <<
-	    "calc grid offsets: " << timestamp_to_str(compute_offsets) << "\n" <<
-	    "calc light list: " << timestamp_to_str(compute_list) << "\n" <<
+	    "animate lights: " << timestamp_to_str(animate) << "\n" <<
+	    pass_strs[0] << timestamp_to_str(compute_flags) << "\n" <<
+	    pass_strs[1] << timestamp_to_str(compute_offsets) << "\n" <<
+	    pass_strs[2] << timestamp_to_str(compute_list) << "\n" <<
 	    "subpass scene, particles, text (4xMSAA): " << timestamp_to_str(onscreen) << "\n" <<
 	    "transfer: " << timestamp_to_str(transfer) << "\n" <<
-	    "GPU total: " << timestamp_to_str(depth + clustering + compute_flags + compute_offsets + compute_list + onscreen + transfer);
+	    "GPU total: " << timestamp_to_str(depth + clustering + animate + compute_flags + compute_offsets + compute_list + onscreen + transfer);
 
 	text=ss.str();
     }
 
+    // ************************************************************************
+    // benchmark, grid autotune and workgroup size tuning
+    // ************************************************************************
+
+    Workgroup_tune *p_workgroup_tune_{nullptr};
+    Benchmark *p_benchmark_{nullptr};
+    Autotune *p_autotune_{nullptr};
+    bool grid_constants_changed_{false};
+
+    // the cached workgroup sizes before the first pipelines, the grid
+    // buffer size of the autotune
+    void init_tuners_()
+    {
+	p_workgroup_tune_=new Workgroup_tune(p_info_, p_phy_dev_->props);
+	p_workgroup_tune_->load_cached_sizes();
+	p_benchmark_=new Benchmark(p_info_, p_shell_);
+	p_autotune_=new Autotune(p_info_, p_camera_, p_phy_dev_->props.limits, max_grid_count_);
+    }
+
+    void destroy_tuners_()
+    {
+	delete p_workgroup_tune_;
+	delete p_benchmark_;
+	delete p_autotune_;
+    }
+
+    // called once per frame with the frame's queries, the workgroup sizes
+    // go first
+    void update_tuners_(const Frame_data &data)
+    {
+	const Query_data &q=data.query_data;
+	const Pass_times times={
+	    q.depth_pass[1] - q.depth_pass[0],
+	    q.clustering[1] - q.clustering[0],
+	    q.animate_lights[1] - q.animate_lights[0],
+	    q.calc_light_grids[1] - q.calc_light_grids[0],
+	    q.calc_grid_offsets[1] - q.calc_grid_offsets[0],
+	    q.calc_light_list[1] - q.calc_light_list[0],
+	    q.onscreen[1] - q.onscreen[0],
+	    q.transfer[1] - q.transfer[0]
+	};
+	Frame_tuner *tuners[]={p_workgroup_tune_, p_benchmark_, p_autotune_};
+	for (Frame_tuner *p_tuner : tuners) {
+	    if (p_tuner->active()) {
+		if (p_tuner->update(times)) grid_constants_changed_=true;
+		break;
+	    }
+	}
+    }
+
     void on_frame_(float elapsed_time, float delta_time)
     {
 	const vk::DeviceSize vb_offset{0};
-	vk::BufferMemoryBarrier barriers[2];
+	vk::BufferMemoryBarrier barriers[3];
 
 	auto &data=frame_data_vec_[frame_data_idx_];
 	auto &back=acquired_back_buf_;
 
 	bool update_text_overlay=text_overlay_update_counter_.silent_update(delta_time);
 
+	if (!p_info_->pause_light_animation) light_time_+=delta_time;
+	p_autotune_->record_camera_path();
+
 	// offscreen
 	{
 	    base::assert_success(p_dev_->dev.waitForFences(1,
@@ -1855,7 +3298,7 @@ private:
 							   UINT64_MAX));
 	    p_dev_->dev.resetFences(1, &data.offscreen_cmd_buf_blk.submit_fence);
 
-	    update_global_uniforms_(data);
+	    update_global_uniforms_(light_time_, data);
 	    if (update_text_overlay) {
 		generate_text_(data, text_overlay_content_);
 		p_text_overlay_->update_text(text_overlay_content_, 0.05, 0.1, 14, p_info_->width(), p_info_->height());
@@ -1864,7 +3307,7 @@ private:
 	    auto &cmd_buf=data.offscreen_cmd_buf_blk.cmd_buffer;
 	    cmd_buf.begin(cmd_begin_info_);
 
-	    cmd_buf.resetQueryPool(data.query_pool, 0, 4);
+	    cmd_buf.resetQueryPool(data.query_pool, OFFSCREEN_QUERY_FIRST, OFFSCREEN_QUERY_COUNT);
 
 	    // host write to shader read
 	    barriers[0]={
@@ -1971,9 +3414,9 @@ private:
 
 	base::assert_success(vkGetQueryPoolResults(static_cast<VkDevice>(p_dev_->dev),
 						   static_cast<VkQueryPool>(data.query_pool),
-						   0, 4,
-						   sizeof(uint32_t) * 4,
-						   &data.query_data,
+						   OFFSCREEN_QUERY_FIRST, OFFSCREEN_QUERY_COUNT,
+						   sizeof(uint32_t) * OFFSCREEN_QUERY_COUNT,
+						   &data.query_data.depth_pass[0],
 						   sizeof(uint32_t),
 						   static_cast<VkQueryResultFlagBits>(vk::QueryResultFlagBits::eWait)));
 
@@ -1985,42 +3428,185 @@ private:
 							   UINT64_MAX));
 	    p_dev_->dev.resetFences(1, &data.compute_cmd_buf_blk.submit_fence);
 
-	    update_light_buffers_(elapsed_time, data);
+	    read_light_count_stats_(data);
+	    update_light_buffers_(light_time_, data);
 
 	    auto &cmd_buf=data.compute_cmd_buf_blk.cmd_buffer;
 	    cmd_buf.begin(cmd_begin_info_);
 
-	    cmd_buf.resetQueryPool(data.query_pool, 4, 6);
+	    cmd_buf.resetQueryPool(data.query_pool, COMPUTE_QUERY_FIRST, COMPUTE_QUERY_COUNT);
 
-	    barriers[0]={
-		vk::AccessFlagBits::eHostWrite,
-		vk::AccessFlagBits::eShaderRead,
-		VK_QUEUE_FAMILY_IGNORED,
-		VK_QUEUE_FAMILY_IGNORED,
-		data.p_light_pos_ranges->p_buf->buf,
-		0, VK_WHOLE_SIZE
-	    };
+	    // --------------------- animate lights ---------------------
+
+	    // reads light_orbits
+	    // writes light_pos_ranges
+
+	    cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_ANIMATE_LIGHTS * 2);
+
+	    if (p_info_->gpu_light_animation) {
+		cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.animate_lights);
+		pipeline_desc_sets_.animate_lights[0]=data.desc_set;
+		cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					   pipeline_layouts_.animate_lights,
+					   0, static_cast<uint32_t>(pipeline_desc_sets_.animate_lights.size()),
+					   pipeline_desc_sets_.animate_lights.data(),
+					   0, nullptr);
+		cmd_buf.dispatch((p_info_->num_lights - 1) / p_info_->workgroup_sizes.animate_lights + 1, 1, 1);
+
+		barriers[0]=vk::BufferMemoryBarrier(vk::AccessFlagBits::eShaderWrite,
+						    vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+						    VK_QUEUE_FAMILY_IGNORED,
+						    VK_QUEUE_FAMILY_IGNORED,
+						    data.p_light_pos_ranges->p_buf->buf,
+						    0, VK_WHOLE_SIZE);
+		cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+					vk::PipelineStageFlagBits::eComputeShader,
+					vk::DependencyFlagBits::eByRegion,
+					0, nullptr, 1, barriers, 0, nullptr);
+	    }
+	    else {
+		barriers[0]={
+		    vk::AccessFlagBits::eHostWrite,
+		    vk::AccessFlagBits::eShaderRead,
+		    VK_QUEUE_FAMILY_IGNORED,
+		    VK_QUEUE_FAMILY_IGNORED,
+		    data.p_light_pos_ranges->p_buf->buf,
+		    0, VK_WHOLE_SIZE
+		};
+		barriers[1]=barriers[0];
+		barriers[1].buffer=data.p_visible_lights->p_buf->buf;
+		cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eHost,
+					vk::PipelineStageFlagBits::eComputeShader,
+					vk::DependencyFlagBits::eByRegion,
+					0, nullptr, 2, barriers, 0, nullptr);
+	    }
+
+	    // written in both modes so the query results are always available
+	    cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_ANIMATE_LIGHTS * 2 + 1);
 
 	    cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_CALC_LIGHT_GRIDS * 2);
 
-	    cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eHost,
-				    vk::PipelineStageFlagBits::eComputeShader,
-				    vk::DependencyFlagBits::eByRegion,
-				    0, nullptr, 1, barriers, 0, nullptr);
+	    const Light_count_push_constants light_count_push_constants{
+		visible_light_count_, lights_culled_ ? 1u : 0u, p_info_->refine_light_cells ? 1u : 0u};
+	    data.light_count_stats_refined=p_info_->refine_light_cells;
+	    light_assignment_used_=p_info_->used_light_assignment();
+	    light_mask_words_=(p_info_->num_lights + 31) / 32;
+	    const bool cluster_parallel=light_assignment_used_ == LIGHT_ASSIGNMENT_CLUSTER_LISTS;
+	    const bool lists_balanced=light_assignment_used_ == LIGHT_ASSIGNMENT_BALANCED_LISTS;
+	    const bool light_list_used=cluster_parallel || lists_balanced || light_assignment_used_ == LIGHT_ASSIGNMENT_LIST;
+	    const bool z_bins_used=light_assignment_used_ == LIGHT_ASSIGNMENT_Z_BINS;
+	    const bool lists_compacted=light_assignment_used_ == LIGHT_ASSIGNMENT_COMPACTED_LISTS;
+	    const bool linked_lists_used=lists_compacted || light_assignment_used_ == LIGHT_ASSIGNMENT_LINKED_LISTS;
 
 	    // --------------------- calc light grids ---------------------
 
-	    // reads grid_flags, light_pos_ranges
-	    // writes light_bounds, grid_light_counts
-
-	    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.calc_light_grids);
+	    // reads grid_flags, light_pos_ranges, visible_lights
+	    // writes light_bounds and grid_light_counts, light_masks or light_depth_keys
+	    // linked lists: writes grid_light_heads, light_nodes
+	    // cluster parallel: the bounds pass writes light_bounds, light_view_spheres,
+	    // then a workgroup per tile column counts the lights of its clusters
+	    // balanced lists: the bounds pass also writes light_chunk_counts, their scan
+	    // writes light_chunks, light_chunk_dispatch, then an invocation per chunk
+	    // counts the lights of its cells
+
+	    vk::Pipeline calc_light_grids=pipelines_.calc_light_grids;
+	    vk::Buffer light_grids_out[2]={p_light_bounds_->p_buf->buf, p_grid_light_counts_->p_buf->buf};
+	    if (light_assignment_used_ == LIGHT_ASSIGNMENT_MASKS) {
+		calc_light_grids=pipelines_.calc_light_grids_masks;
+		light_grids_out[1]=p_light_masks_->p_buf->buf;
+	    }
+	    else if (z_bins_used) {
+		calc_light_grids=pipelines_.calc_light_grids_z_bins;
+		light_grids_out[1]=p_light_depth_keys_->p_buf->buf;
+	    }
+	    else if (linked_lists_used) {
+		calc_light_grids=pipelines_.calc_light_grids_linked_lists;
+		light_grids_out[0]=p_light_nodes_->p_buf->buf;
+		light_grids_out[1]=p_grid_light_heads_->p_buf->buf;
+	    }
+	    else if (cluster_parallel) {
+		calc_light_grids=pipelines_.calc_light_grids_bounds;
+	    }
+	    else if (lists_balanced) {
+		calc_light_grids=pipelines_.calc_light_grids_chunks;
+	    }
+	    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, calc_light_grids);
 	    pipeline_desc_sets_.calc_light_grids[0]=data.desc_set;
 	    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
 				       pipeline_layouts_.calc_light_grids,
 				       0, static_cast<uint32_t>(pipeline_desc_sets_.calc_light_grids.size()),
 				       pipeline_desc_sets_.calc_light_grids.data(),
 				       0, nullptr);
-	    cmd_buf.dispatch((p_info_->num_lights - 1) / 32 + 1, 1, 1);
+	    cmd_buf.pushConstants(pipeline_layouts_.calc_light_grids, vk::ShaderStageFlagBits::eCompute,
+				  0, sizeof(Light_count_push_constants), &light_count_push_constants);
+	    if (visible_light_count_) cmd_buf.dispatch((visible_light_count_ - 1) / p_info_->workgroup_sizes.calc_light_grids + 1, 1, 1);
+
+	    if (cluster_parallel || lists_balanced) {
+		vk::BufferMemoryBarrier bounds_barriers[3];
+		bounds_barriers[0]=vk::BufferMemoryBarrier(vk::AccessFlagBits::eShaderWrite,
+							   vk::AccessFlagBits::eShaderRead,
+							   VK_QUEUE_FAMILY_IGNORED,
+							   VK_QUEUE_FAMILY_IGNORED,
+							   p_light_bounds_->p_buf->buf,
+							   0, VK_WHOLE_SIZE);
+		bounds_barriers[1]=bounds_barriers[0];
+		bounds_barriers[1].buffer=p_light_view_spheres_->p_buf->buf;
+		bounds_barriers[2]=bounds_barriers[0];
+		bounds_barriers[2].buffer=p_light_chunk_counts_->p_buf->buf;
+		cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+					vk::PipelineStageFlagBits::eComputeShader,
+					vk::DependencyFlagBits::eByRegion,
+					0, nullptr, lists_balanced ? 3 : 2, bounds_barriers, 0, nullptr);
+
+		pipeline_desc_sets_.calc_light_list[0]=data.desc_set;
+		cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					   pipeline_layouts_.calc_light_list,
+					   0, static_cast<uint32_t>(pipeline_desc_sets_.calc_light_list.size()),
+					   pipeline_desc_sets_.calc_light_list.data(),
+					   0, nullptr);
+		cmd_buf.pushConstants(pipeline_layouts_.calc_light_list, vk::ShaderStageFlagBits::eCompute,
+				      0, sizeof(Light_count_push_constants), &light_count_push_constants);
+
+		// the chunk counts scanned in gid order, the chunk list is the same
+		// on every run. without lights the cleared dispatch stays empty
+		if (lists_balanced && visible_light_count_) {
+		    const uint32_t block_count=(visible_light_count_ - 1) / SCAN_BLOCK_SIZE + 1;
+
+		    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.scan_light_chunk_counts);
+		    cmd_buf.dispatch(block_count, 1, 1);
+
+		    barriers[0]=vk::BufferMemoryBarrier(vk::AccessFlagBits::eShaderWrite,
+							vk::AccessFlagBits::eShaderRead,
+							VK_QUEUE_FAMILY_IGNORED,
+							VK_QUEUE_FAMILY_IGNORED,
+							p_light_chunk_offsets_->p_buf->buf,
+							0, VK_WHOLE_SIZE);
+		    barriers[1]=barriers[0];
+		    barriers[1].buffer=p_grid_block_sums_->p_buf->buf;
+		    cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+					    vk::PipelineStageFlagBits::eComputeShader,
+					    vk::DependencyFlagBits::eByRegion,
+					    0, nullptr, 2, barriers, 0, nullptr);
+
+		    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.add_light_chunk_offsets);
+		    cmd_buf.dispatch(block_count, 1, 1);
+
+		    barriers[0].buffer=p_light_chunks_->p_buf->buf;
+		    barriers[1].buffer=p_light_chunk_dispatch_->p_buf->buf;
+		    barriers[1].dstAccessMask=vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead;
+		    cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+					    vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader,
+					    vk::DependencyFlagBits::eByRegion,
+					    0, nullptr, 2, barriers, 0, nullptr);
+		}
+
+		// a workgroup per tile column and an invocation per z slice, or an
+		// invocation per chunk of light cells
+		cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute,
+				     lists_balanced ? pipelines_.calc_light_chunk_counts : pipelines_.calc_cluster_light_counts);
+		if (lists_balanced) cmd_buf.dispatchIndirect(p_light_chunk_dispatch_->p_buf->buf, 0);
+		else if (visible_light_count_) cmd_buf.dispatch(p_info_->tile_count_x, p_info_->tile_count_y, 1);
+	    }
 
 	    cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_CALC_LIGHT_GRIDS * 2 + 1);
 
@@ -2028,55 +3614,185 @@ private:
 						vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
 						VK_QUEUE_FAMILY_IGNORED,
 						VK_QUEUE_FAMILY_IGNORED,
-						p_light_bounds_->p_buf->buf,
+						light_grids_out[0],
 						0, VK_WHOLE_SIZE);
 	    barriers[1]=barriers[0];
-	    barriers[1].buffer=p_grid_light_counts_->p_buf->buf;
+	    barriers[1].buffer=light_grids_out[1];
 	    cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
 				    vk::PipelineStageFlagBits::eComputeShader,
 				    vk::DependencyFlagBits::eByRegion,
 				    0, nullptr, 2, barriers, 0, nullptr);
 
+	    // --------------------- calc light count stats ---------------------
+
+	    // reads grid_light_counts, active_clusters, active_cluster_dispatch
+	    // writes light_count_stats, outside of the timed passes
+
+	    // the light masks and linked lists are complete here, the stats,
+	    // offsets and list passes only write their timestamps. the z-bins
+	    // sort the lights in the offsets pass and fill the bins in the list
+	    // pass, the compacted lists are flattened in the list pass
+	    if (light_list_used) {
+		cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.calc_light_count_stats);
+		pipeline_desc_sets_.calc_grid_offsets[0]=data.desc_set;
+		cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					   pipeline_layouts_.calc_grid_offsets,
+					   0, static_cast<uint32_t>(pipeline_desc_sets_.calc_grid_offsets.size()),
+					   pipeline_desc_sets_.calc_grid_offsets.data(),
+					   0, nullptr);
+		cmd_buf.dispatchIndirect(p_active_cluster_dispatch_->p_buf->buf, 0);
+
+		// barriers keeps the masks of the light grids barrier for the offsets passes
+		const vk::BufferMemoryBarrier stats_barrier(vk::AccessFlagBits::eShaderWrite,
+							    vk::AccessFlagBits::eHostRead,
+							    VK_QUEUE_FAMILY_IGNORED,
+							    VK_QUEUE_FAMILY_IGNORED,
+							    data.p_light_count_stats->p_buf->buf,
+							    0, VK_WHOLE_SIZE);
+		cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+					vk::PipelineStageFlagBits::eHost,
+					vk::DependencyFlagBits::eByRegion,
+					0, nullptr, 1, &stats_barrier, 0, nullptr);
+	    }
+
 	    // --------------------- calc grid offsets ---------------------
 
-	    // reads grid_flags, grid_light_counts
+	    // reads grid_flags, grid_light_counts, active_clusters, active_cluster_dispatch
 	    // writes grid_light_count_total, grid_light_offsets
+	    // z-bins: sorts light_depth_keys
 
 	    cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_CALC_GRID_OFFSETS * 2);
 
-	    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.calc_grid_offsets);
-	    pipeline_desc_sets_.calc_grid_offsets[0]=data.desc_set;
-	    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
-				       pipeline_layouts_.calc_grid_offsets,
-				       0, static_cast<uint32_t>(pipeline_desc_sets_.calc_grid_offsets.size()),
-				       pipeline_desc_sets_.calc_grid_offsets.data(),
-				       0, nullptr);
-	    cmd_buf.dispatch((p_info_->tile_count_x - 1) / 16 + 1, (p_info_->tile_count_y - 1) / 16 + 1, p_info_->TILE_COUNT_Z);
+	    if (light_list_used) {
+		pipeline_desc_sets_.calc_grid_offsets[0]=data.desc_set;
+		if (p_info_->grid_offsets_mode == GRID_OFFSETS_PREFIX_SUM) {
+		    const uint32_t grid_count=p_info_->tile_count_x * p_info_->tile_count_y * p_info_->TILE_COUNT_Z;
+		    const uint32_t block_count=(grid_count - 1) / SCAN_BLOCK_SIZE + 1;
+
+		    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.scan_grid_light_counts);
+		    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					       pipeline_layouts_.calc_grid_offsets,
+					       0, static_cast<uint32_t>(pipeline_desc_sets_.calc_grid_offsets.size()),
+					       pipeline_desc_sets_.calc_grid_offsets.data(),
+					       0, nullptr);
+		    cmd_buf.dispatch(block_count, 1, 1);
+
+		    barriers[0].buffer=p_grid_light_count_offsets_->p_buf->buf;
+		    barriers[1].buffer=p_grid_block_sums_->p_buf->buf;
+		    cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+					    vk::PipelineStageFlagBits::eComputeShader,
+					    vk::DependencyFlagBits::eByRegion,
+					    0, nullptr, 2, barriers, 0, nullptr);
+
+		    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.add_grid_block_offsets);
+		    cmd_buf.dispatch(block_count, 1, 1);
+		}
+		else if (p_info_->grid_offsets_mode == GRID_OFFSETS_ACTIVE_CLUSTERS) {
+		    // group count written by clustering.frag, scales with the flagged clusters
+		    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.calc_active_grid_offsets);
+		    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					       pipeline_layouts_.calc_grid_offsets,
+					       0, static_cast<uint32_t>(pipeline_desc_sets_.calc_grid_offsets.size()),
+					       pipeline_desc_sets_.calc_grid_offsets.data(),
+					       0, nullptr);
+		    cmd_buf.dispatchIndirect(p_active_cluster_dispatch_->p_buf->buf, 0);
+		}
+		else {
+		    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.calc_grid_offsets);
+		    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					       pipeline_layouts_.calc_grid_offsets,
+					       0, static_cast<uint32_t>(pipeline_desc_sets_.calc_grid_offsets.size()),
+					       pipeline_desc_sets_.calc_grid_offsets.data(),
+					       0, nullptr);
+		    cmd_buf.dispatch((p_info_->tile_count_x - 1) / p_info_->workgroup_sizes.calc_grid_offsets_x + 1,
+				     (p_info_->tile_count_y - 1) / p_info_->workgroup_sizes.calc_grid_offsets_y + 1,
+				     p_info_->TILE_COUNT_Z);
+		}
+	    }
+	    else if (z_bins_used) {
+		// a single workgroup, the keys fit its shared memory
+		cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.sort_light_depths);
+		pipeline_desc_sets_.calc_light_list[0]=data.desc_set;
+		cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					   pipeline_layouts_.calc_light_list,
+					   0, static_cast<uint32_t>(pipeline_desc_sets_.calc_light_list.size()),
+					   pipeline_desc_sets_.calc_light_list.data(),
+					   0, nullptr);
+		cmd_buf.pushConstants(pipeline_layouts_.calc_light_list, vk::ShaderStageFlagBits::eCompute,
+				      0, sizeof(Light_count_push_constants), &light_count_push_constants);
+		if (visible_light_count_) cmd_buf.dispatch(1, 1, 1);
+	    }
 
 	    cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_CALC_GRID_OFFSETS * 2 + 1);
 
-	    barriers[0].buffer=p_grid_light_count_total_->p_buf->buf;
-	    barriers[1].buffer=p_grid_light_count_offsets_->p_buf->buf;
-	    cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
-				    vk::PipelineStageFlagBits::eComputeShader,
-				    vk::DependencyFlagBits::eByRegion,
-				    0, nullptr, 1, barriers, 0, nullptr);
+	    if (light_list_used) {
+		barriers[0].buffer=p_grid_light_count_total_->p_buf->buf;
+		barriers[1].buffer=p_grid_light_count_offsets_->p_buf->buf;
+		barriers[2]=barriers[0];
+		barriers[2].buffer=p_grid_flags_->p_buf->buf;
+		cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+					vk::PipelineStageFlagBits::eComputeShader,
+					vk::DependencyFlagBits::eByRegion,
+					0, nullptr, 3, barriers, 0, nullptr);
+	    }
+	    else if (z_bins_used) {
+		barriers[0].buffer=p_light_depth_keys_->p_buf->buf;
+		cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+					vk::PipelineStageFlagBits::eComputeShader,
+					vk::DependencyFlagBits::eByRegion,
+					0, nullptr, 1, barriers, 0, nullptr);
+	    }
 
 	    // --------------------- calc light list ---------------------
 
-	    // reads grid_flags, light_bounds, grid_light_counts, grid_light_offsets
+	    // reads grid_flags, light_bounds, grid_light_counts, grid_light_offsets, visible_lights
 	    // writes grid_light_counts_compare, light_list
+	    // z-bins: reads light_bounds, light_depth_keys, writes z_bins, tile_light_masks
+	    // compacted lists: reads grid_light_heads, light_nodes, active_clusters,
+	    // writes grid_flags, grid_light_counts, grid_light_count_total, grid_light_offsets, light_list
+	    // cluster parallel: writes light_list only
+	    // balanced lists: reads light_chunks, light_chunk_dispatch
 
 	    cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_CALC_LIGHT_LIST * 2);
 
-	    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.calc_light_list);
-	    pipeline_desc_sets_.calc_light_list[0]=data.desc_set;
-	    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
-				       pipeline_layouts_.calc_light_list,
-				       0, static_cast<uint32_t>(pipeline_desc_sets_.calc_light_list.size()),
-				       pipeline_desc_sets_.calc_light_list.data(),
-				       0, nullptr);
-	    cmd_buf.dispatch((p_info_->num_lights - 1) / 32 + 1, 1, 1);
+	    if (lists_compacted) {
+		cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.compact_light_lists);
+		pipeline_desc_sets_.calc_grid_offsets[0]=data.desc_set;
+		cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					   pipeline_layouts_.calc_grid_offsets,
+					   0, static_cast<uint32_t>(pipeline_desc_sets_.calc_grid_offsets.size()),
+					   pipeline_desc_sets_.calc_grid_offsets.data(),
+					   0, nullptr);
+		cmd_buf.dispatchIndirect(p_active_cluster_dispatch_->p_buf->buf, 0);
+	    }
+
+	    if (cluster_parallel || lists_balanced) {
+		cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute,
+				     lists_balanced ? pipelines_.calc_light_chunk_list : pipelines_.calc_cluster_light_list);
+		pipeline_desc_sets_.calc_light_list[0]=data.desc_set;
+		cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					   pipeline_layouts_.calc_light_list,
+					   0, static_cast<uint32_t>(pipeline_desc_sets_.calc_light_list.size()),
+					   pipeline_desc_sets_.calc_light_list.data(),
+					   0, nullptr);
+		cmd_buf.pushConstants(pipeline_layouts_.calc_light_list, vk::ShaderStageFlagBits::eCompute,
+				      0, sizeof(Light_count_push_constants), &light_count_push_constants);
+		if (lists_balanced) cmd_buf.dispatchIndirect(p_light_chunk_dispatch_->p_buf->buf, 0);
+		else if (visible_light_count_) cmd_buf.dispatch(p_info_->tile_count_x, p_info_->tile_count_y, 1);
+	    }
+	    else if (light_list_used || z_bins_used) {
+		cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute,
+				     z_bins_used ? pipelines_.calc_z_bins : pipelines_.calc_light_list);
+		pipeline_desc_sets_.calc_light_list[0]=data.desc_set;
+		cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+					   pipeline_layouts_.calc_light_list,
+					   0, static_cast<uint32_t>(pipeline_desc_sets_.calc_light_list.size()),
+					   pipeline_desc_sets_.calc_light_list.data(),
+					   0, nullptr);
+		cmd_buf.pushConstants(pipeline_layouts_.calc_light_list, vk::ShaderStageFlagBits::eCompute,
+				      0, sizeof(Light_count_push_constants), &light_count_push_constants);
+		if (visible_light_count_) cmd_buf.dispatch((visible_light_count_ - 1) / p_info_->workgroup_sizes.calc_light_list + 1, 1, 1);
+	    }
 
 	    cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eFragmentShader, data.query_pool, QUERY_CALC_LIGHT_LIST * 2 + 1);
 
@@ -2090,9 +3806,9 @@ private:
 
 	base::assert_success(vkGetQueryPoolResults(static_cast<VkDevice>(p_dev_->dev),
 						   static_cast<VkQueryPool>(data.query_pool),
-						   4, 6,
-						   sizeof(uint32_t) * 6,
-						   &data.query_data.calc_light_grids[0],
+						   COMPUTE_QUERY_FIRST, COMPUTE_QUERY_COUNT,
+						   sizeof(uint32_t) * COMPUTE_QUERY_COUNT,
+						   &data.query_data.animate_lights[0],
 						   sizeof(uint32_t),
 						   static_cast<VkQueryResultFlagBits>(vk::QueryResultFlagBits::eWait)));
 
@@ -2104,10 +3820,16 @@ private:
 							   UINT64_MAX));
 	    p_dev_->dev.resetFences(1, &data.onscreen_cmd_buf_blk.submit_fence);
 
+	    read_light_list_feedback_(data);
+	    data.light_list_capacity=p_info_->light_list_capacity;
+	    data.light_list_written=p_info_->used_light_assignment() != LIGHT_ASSIGNMENT_MASKS &&
+		p_info_->used_light_assignment() != LIGHT_ASSIGNMENT_Z_BINS;
+	    data.light_chunk_capacity=light_chunk_capacity_;
+
 	    auto &cmd_buf=data.onscreen_cmd_buf_blk.cmd_buffer;
 	    cmd_buf.begin(cmd_begin_info_);
 
-	    cmd_buf.resetQueryPool(data.query_pool, 10, 4);
+	    cmd_buf.resetQueryPool(data.query_pool, ONSCREEN_QUERY_FIRST, ONSCREEN_QUERY_COUNT);
 
 	    // render pass
 	    {
@@ -2128,16 +3850,29 @@ private:
 
 		    pipeline_desc_sets_.cluster_forward[2]=data.desc_set;
 
+		    vk::Pipeline opaque=pipelines_.cluster_forward_opaque;
+		    vk::Pipeline transparent=pipelines_.cluster_forward_transparent;
+		    if (light_assignment_used_ == LIGHT_ASSIGNMENT_MASKS) {
+			opaque=pipelines_.cluster_forward_masks_opaque;
+			transparent=pipelines_.cluster_forward_masks_transparent;
+		    }
+		    else if (light_assignment_used_ == LIGHT_ASSIGNMENT_Z_BINS) {
+			opaque=pipelines_.cluster_forward_z_bins_opaque;
+			transparent=pipelines_.cluster_forward_z_bins_transparent;
+		    }
+		    else if (light_assignment_used_ == LIGHT_ASSIGNMENT_LINKED_LISTS) {
+			opaque=pipelines_.cluster_forward_linked_lists_opaque;
+			transparent=pipelines_.cluster_forward_linked_lists_transparent;
+		    }
+
 		    // scene parts have been sorted
 		    // the opaque are drawn first
 		    for (auto &part : p_model_->scene_parts) {
 			if (part.p_mtl->properties.alpha < 1.f) {
-			    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics,
-						 pipelines_.cluster_forward_transparent);
+			    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, transparent);
 			}
 			else {
-			    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics,
-						 pipelines_.cluster_forward_opaque);
+			    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, opaque);
 			}
 			pipeline_desc_sets_.cluster_forward[1]=part.p_mtl->desc_set_sampler;
 			cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
@@ -2190,9 +3925,9 @@ private:
 
 	    // clean up buffers
 	    {
-		std::vector<vk::BufferMemoryBarrier> transfer_barriers{4,
+		std::vector<vk::BufferMemoryBarrier> transfer_barriers{13,
 		    vk::BufferMemoryBarrier(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
-					    vk::AccessFlagBits::eTransferWrite,
+					    vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite,
 					    VK_QUEUE_FAMILY_IGNORED,
 					    VK_QUEUE_FAMILY_IGNORED,
 					    p_grid_flags_->p_buf->buf,
@@ -2200,6 +3935,15 @@ private:
 		transfer_barriers[1].buffer=p_grid_light_counts_->p_buf->buf;
 		transfer_barriers[2].buffer=p_grid_light_count_offsets_->p_buf->buf;
 		transfer_barriers[3].buffer=p_light_list_->p_buf->buf;
+		transfer_barriers[4].buffer=p_active_cluster_dispatch_->p_buf->buf;
+		transfer_barriers[5].buffer=p_light_masks_->p_buf->buf;
+		transfer_barriers[6].buffer=p_z_bins_->p_buf->buf;
+		transfer_barriers[7].buffer=p_tile_light_masks_->p_buf->buf;
+		transfer_barriers[8].buffer=p_grid_light_heads_->p_buf->buf;
+		transfer_barriers[9].buffer=p_light_nodes_->p_buf->buf;
+		transfer_barriers[10].buffer=p_light_bounds_->p_buf->buf;
+		transfer_barriers[11].buffer=p_light_chunk_dispatch_->p_buf->buf;
+		transfer_barriers[12].buffer=p_grid_light_count_total_->p_buf->buf;
 
 		cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_TRANSFER * 2);
 
@@ -2211,30 +3955,123 @@ private:
 					transfer_barriers.data(),
 					0, nullptr);
 
+		// list demand of the frame, read back for the capacity before the
+		// buffers are cleared. the counts are undefined until the first clear
+		if (assignment_buffers_cleared_) {
+		    const vk::BufferCopy feedback_copies[3]={
+			vk::BufferCopy(0, 0, sizeof(uint32_t)),
+			vk::BufferCopy(0, sizeof(uint32_t), sizeof(uint32_t)),
+			vk::BufferCopy(3 * sizeof(uint32_t), 2 * sizeof(uint32_t), sizeof(uint32_t))
+		    };
+		    cmd_buf.copyBuffer(p_grid_light_count_total_->p_buf->buf,
+				       data.p_light_list_feedback->p_buf->buf,
+				       1, &feedback_copies[0]);
+		    cmd_buf.copyBuffer(p_light_nodes_->p_buf->buf,
+				       data.p_light_list_feedback->p_buf->buf,
+				       1, &feedback_copies[1]);
+		    cmd_buf.copyBuffer(p_light_chunk_dispatch_->p_buf->buf,
+				       data.p_light_list_feedback->p_buf->buf,
+				       1, &feedback_copies[2]);
+		    const vk::BufferMemoryBarrier feedback_barrier(vk::AccessFlagBits::eTransferWrite,
+								   vk::AccessFlagBits::eHostRead,
+								   VK_QUEUE_FAMILY_IGNORED,
+								   VK_QUEUE_FAMILY_IGNORED,
+								   data.p_light_list_feedback->p_buf->buf,
+								   0, VK_WHOLE_SIZE);
+		    // the clears below overwrite the copied counts
+		    cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+					    vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eHost,
+					    vk::DependencyFlagBits::eByRegion,
+					    0, nullptr, 1, &feedback_barrier, 0, nullptr);
+		}
+
 		cmd_buf.fillBuffer(p_grid_flags_->p_buf->buf,
 				   0, VK_WHOLE_SIZE,
 				   0);
-		cmd_buf.fillBuffer(p_light_bounds_->p_buf->buf,
-				   0, VK_WHOLE_SIZE,
-				   0);
-		cmd_buf.fillBuffer(p_grid_light_counts_->p_buf->buf,
-				   0, VK_WHOLE_SIZE,
-				   0);
-		cmd_buf.fillBuffer(p_grid_light_count_offsets_->p_buf->buf,
-				   0, VK_WHOLE_SIZE,
-				   0);
-		cmd_buf.fillBuffer(p_grid_light_count_total_->p_buf->buf,
-				   0, VK_WHOLE_SIZE,
-				   0);
-		cmd_buf.fillBuffer(p_light_list_->p_buf->buf,
-				   0, VK_WHOLE_SIZE,
-				   0);
-		cmd_buf.fillBuffer(p_grid_light_counts_compare_->p_buf->buf,
-				   0, VK_WHOLE_SIZE,
-				   0);
+		const bool linked_lists_used=light_assignment_used_ == LIGHT_ASSIGNMENT_LINKED_LISTS ||
+		    light_assignment_used_ == LIGHT_ASSIGNMENT_COMPACTED_LISTS;
+		if (linked_lists_used) {
+		    // the nodes past the count are overwritten before they are read
+		    const uint32_t grid_count=p_info_->tile_count_x * p_info_->tile_count_y * p_info_->TILE_COUNT_Z;
+		    cmd_buf.fillBuffer(p_grid_light_heads_->p_buf->buf,
+				       0, grid_count * sizeof(uint32_t),
+				       0);
+		    cmd_buf.fillBuffer(p_light_nodes_->p_buf->buf,
+				       0, sizeof(uint32_t),
+				       0);
+		}
+		else {
+		    // untouched by the linked lists
+		    cmd_buf.fillBuffer(p_light_bounds_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		}
+		if (light_assignment_used_ == LIGHT_ASSIGNMENT_MASKS) {
+		    // only the words of this frame's grid and light count are set
+		    const uint32_t grid_count=p_info_->tile_count_x * p_info_->tile_count_y * p_info_->TILE_COUNT_Z;
+		    cmd_buf.fillBuffer(p_light_masks_->p_buf->buf,
+				       0, grid_count * light_mask_words_ * sizeof(uint32_t),
+				       0);
+		}
+		else if (light_assignment_used_ == LIGHT_ASSIGNMENT_Z_BINS) {
+		    const uint32_t tile_count=p_info_->tile_count_x * p_info_->tile_count_y;
+		    cmd_buf.fillBuffer(p_tile_light_masks_->p_buf->buf,
+				       0, tile_count * light_mask_words_ * sizeof(uint32_t),
+				       0);
+		    cmd_buf.fillBuffer(p_z_bins_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		}
+		else if (light_assignment_used_ != LIGHT_ASSIGNMENT_LINKED_LISTS) {
+		    // the list buffers stay cleared while the other assignments are used
+		    cmd_buf.fillBuffer(p_grid_light_counts_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		    cmd_buf.fillBuffer(p_grid_light_count_offsets_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		    cmd_buf.fillBuffer(p_grid_light_count_total_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		    cmd_buf.fillBuffer(p_light_list_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		    cmd_buf.fillBuffer(p_grid_light_counts_compare_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		}
+		if (!assignment_buffers_cleared_) {
+		    // device memory starts out undefined
+		    cmd_buf.fillBuffer(p_light_masks_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		    cmd_buf.fillBuffer(p_tile_light_masks_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		    cmd_buf.fillBuffer(p_z_bins_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		    cmd_buf.fillBuffer(p_grid_light_heads_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		    cmd_buf.fillBuffer(p_light_nodes_->p_buf->buf,
+				       0, sizeof(uint32_t),
+				       0);
+		    cmd_buf.fillBuffer(p_grid_light_count_total_->p_buf->buf,
+				       0, VK_WHOLE_SIZE,
+				       0);
+		    assignment_buffers_cleared_=true;
+		}
+		const uint32_t active_cluster_dispatch[4]={0, 1, 1, 0};
+		cmd_buf.updateBuffer(p_active_cluster_dispatch_->p_buf->buf,
+				     0, sizeof(active_cluster_dispatch),
+				     active_cluster_dispatch);
+		cmd_buf.updateBuffer(p_light_chunk_dispatch_->p_buf->buf,
+				     0, sizeof(active_cluster_dispatch),
+				     active_cluster_dispatch);
 
 		transfer_barriers.clear();
-		transfer_barriers.resize(4,
+		transfer_barriers.resize(13,
 					 vk::BufferMemoryBarrier(vk::AccessFlagBits::eTransferWrite,
 								 vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
 								 VK_QUEUE_FAMILY_IGNORED,
@@ -2244,6 +4081,15 @@ private:
 		transfer_barriers[1].buffer=p_grid_light_counts_->p_buf->buf;
 		transfer_barriers[2].buffer=p_grid_light_count_offsets_->p_buf->buf;
 		transfer_barriers[3].buffer=p_light_list_->p_buf->buf;
+		transfer_barriers[4].buffer=p_active_cluster_dispatch_->p_buf->buf;
+		transfer_barriers[5].buffer=p_light_masks_->p_buf->buf;
+		transfer_barriers[6].buffer=p_z_bins_->p_buf->buf;
+		transfer_barriers[7].buffer=p_tile_light_masks_->p_buf->buf;
+		transfer_barriers[8].buffer=p_grid_light_heads_->p_buf->buf;
+		transfer_barriers[9].buffer=p_light_nodes_->p_buf->buf;
+		transfer_barriers[10].buffer=p_light_bounds_->p_buf->buf;
+		transfer_barriers[11].buffer=p_light_chunk_dispatch_->p_buf->buf;
+		transfer_barriers[12].buffer=p_grid_light_count_total_->p_buf->buf;
 		cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
 					vk::PipelineStageFlagBits::eFragmentShader,
 					vk::DependencyFlagBits::eByRegion,
@@ -2270,12 +4116,14 @@ private:
 
 	base::assert_success(vkGetQueryPoolResults(static_cast<VkDevice>(p_dev_->dev),
 						   static_cast<VkQueryPool>(data.query_pool),
-						   10, 4,
-						   sizeof(uint32_t) * 4,
+						   ONSCREEN_QUERY_FIRST, ONSCREEN_QUERY_COUNT,
+						   sizeof(uint32_t) * ONSCREEN_QUERY_COUNT,
 						   &data.query_data.onscreen[0],
 						   sizeof(uint32_t),
 						   static_cast<VkQueryResultFlagBits>(vk::QueryResultFlagBits::eWait)));
 
+	update_tuners_(data);
+
 	frame_data_idx_=(frame_data_idx_ + 1) % frame_data_count_;
     }
 };
@@ -50,6 +50,30 @@ public:
 		break;
 	    case base::KEY_NUM_9:p_info_->decrease_num_lights();
 		break;
+	    case base::KEY_F1:p_info_->toggle_gpu_light_animation();
+		break;
+	    case base::KEY_F2:p_info_->toggle_incremental_light_resize();
+		break;
+	    case base::KEY_F3:p_info_->toggle_rescale_light_ranges();
+		break;
+	    case base::KEY_F4:p_info_->cycle_animated_light_fraction();
+		break;
+	    case base::KEY_F5:p_info_->cycle_light_sort_interval();
+		break;
+	    case base::KEY_F6:p_info_->toggle_cpu_light_culling();
+		break;
+	    case base::KEY_F7:p_info_->cycle_grid_offsets_mode();
+		break;
+	    case base::KEY_F8:p_info_->toggle_refine_light_cells();
+		break;
+	    case base::KEY_F9:p_info_->cycle_light_assignment();
+		break;
+	    case base::KEY_F10:p_info_->toggle_camera_path_recording();
+		break;
+	    case base::KEY_F11:p_info_->start_autotune();
+		break;
+	    case base::KEY_SPACE:p_info_->toggle_pause_light_animation();
+		break;
 
 	    default:base::Shell_base::on_key(key);
 		break;
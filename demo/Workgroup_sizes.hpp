@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// local sizes of the light assignment compute shaders, specialized as
+// constant_id 3 (x) and 4 (y). the dispatches divide by the same values
+struct Workgroup_sizes
+{
+    uint32_t animate_lights{32}; // packed and unpacked
+    uint32_t calc_light_grids{32}; // every variant
+    uint32_t calc_light_list{32}; // and calc_z_bins
+    uint32_t calc_grid_offsets_x{16};
+    uint32_t calc_grid_offsets_y{16};
+};
+
+// the tuned sizes per device, one line each: the five sizes, then the device
+// name up to the end of the line
+const char WORKGROUP_SIZES_CACHE[]="workgroup_sizes.txt";
+
+// false for lines of another format
+bool parse_workgroup_sizes_line(const char *p_line, Workgroup_sizes &sizes, std::string &device_name)
+{
+    int name_pos=0;
+    if (sscanf(p_line, "%u %u %u %u %u %n", &sizes.animate_lights, &sizes.calc_light_grids, &sizes.calc_light_list,
+               &sizes.calc_grid_offsets_x, &sizes.calc_grid_offsets_y, &name_pos) != 5 || name_pos == 0) return false;
+    device_name=p_line + name_pos;
+    while (!device_name.empty() && (device_name.back() == '\n' || device_name.back() == '\r')) device_name.pop_back();
+    return sizes.animate_lights && sizes.calc_light_grids && sizes.calc_light_list &&
+        sizes.calc_grid_offsets_x && sizes.calc_grid_offsets_y;
+}
+
+bool load_workgroup_sizes(const char *p_path, const std::string &device_name, Workgroup_sizes &sizes)
+{
+    FILE *p_file=fopen(p_path, "r");
+    if (!p_file) return false;
+
+    bool found=false;
+    char line[512];
+    while (!found && fgets(line, sizeof(line), p_file)) {
+        Workgroup_sizes s;
+        std::string name;
+        if (parse_workgroup_sizes_line(line, s, name) && name == device_name) {
+            sizes=s;
+            found=true;
+        }
+    }
+    fclose(p_file);
+    return found;
+}
+
+// replaces the device's line, keeps the other devices
+void save_workgroup_sizes(const char *p_path, const std::string &device_name, const Workgroup_sizes &sizes)
+{
+    std::vector<std::string> lines;
+    if (FILE *p_file=fopen(p_path, "r")) {
+        char line[512];
+        while (fgets(line, sizeof(line), p_file)) {
+            Workgroup_sizes s;
+            std::string name;
+            if (parse_workgroup_sizes_line(line, s, name) && name == device_name) continue;
+            lines.emplace_back(line);
+            if (lines.back().back() != '\n') lines.back()+='\n';
+        }
+        fclose(p_file);
+    }
+
+    FILE *p_file=fopen(p_path, "w");
+    if (!p_file) return;
+    for (const auto &line : lines) fputs(line.c_str(), p_file);
+    fprintf(p_file, "%u %u %u %u %u %s\n", sizes.animate_lights, sizes.calc_light_grids, sizes.calc_light_list,
+            sizes.calc_grid_offsets_x, sizes.calc_grid_offsets_y, device_name.c_str());
+    fclose(p_file);
+}
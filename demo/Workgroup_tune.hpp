@@ -0,0 +1,177 @@
+#pragma once
+#include "Prog_info.hpp"
+#include "Workgroup_sizes.hpp"
+#include "Frame_tuner.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+// local sizes of animate lights, calc light grids, calc light list and calc
+// grid offsets tried in rounds. the passes have their own timestamps, so a
+// round times one candidate of each and the fastest per pass is kept. runs
+// the GPU light animation and the light list with atomic grid offsets, which
+// use all four, at WORKGROUP_TUNE_MIN_LIGHTS lights or more, and caches the
+// winners under the device name. only runs when asked for, devices without
+// a cached entry keep the Workgroup_sizes defaults
+class Workgroup_tune : public Frame_tuner
+{
+public:
+    Workgroup_tune(Prog_info *p_info, const vk::PhysicalDeviceProperties &props)
+        :p_info_(p_info),
+        limits_(props.limits),
+        device_name_(props.deviceName)
+    {}
+
+    bool active() const override
+    {
+        return p_info_->tune_workgroup_sizes;
+    }
+
+    // the cached sizes of the device, the defaults without them
+    void load_cached_sizes()
+    {
+        load_workgroup_sizes(WORKGROUP_SIZES_CACHE, device_name_, p_info_->workgroup_sizes);
+    }
+
+    // round and round count for the text overlay, 0 / 0 before the first one
+    size_t round() const
+    {
+        return candidates_.empty() ? 0 : round_ + 1;
+    }
+
+    size_t round_count() const
+    {
+        return candidates_.size();
+    }
+
+    bool update(const Pass_times &times) override
+    {
+        if (candidates_.empty()) {
+            init_candidates_();
+            num_lights_=p_info_->num_lights;
+            light_assignment_=p_info_->light_assignment;
+            grid_offsets_mode_=p_info_->grid_offsets_mode;
+            gpu_light_animation_=p_info_->gpu_light_animation;
+            p_info_->num_lights=std::max(WORKGROUP_TUNE_MIN_LIGHTS, num_lights_);
+            p_info_->light_assignment=LIGHT_ASSIGNMENT_LIST;
+            p_info_->grid_offsets_mode=GRID_OFFSETS_ATOMIC;
+            p_info_->gpu_light_animation=true;
+            p_info_->gen_lights=true;
+            for (auto &ms : best_ms_) ms=std::numeric_limits<float>::max();
+            printf("workgroup size tuning, %s, %ux%u, %u lights, GPU ms per frame\n",
+                   device_name_.c_str(), p_info_->width(), p_info_->height(), p_info_->num_lights);
+            printf("%7s  %8s  %6s  %8s  %6s  %8s  %7s  %8s\n",
+                   "animate", "GPU ms", "grids", "GPU ms", "list", "GPU ms", "offsets", "GPU ms");
+            round_=0;
+            start_round_();
+            return true;
+        }
+
+        if (++frame_ > WORKGROUP_TUNE_WARMUP_FRAMES) {
+            gpu_ns_[0]+=times.animate_lights;
+            gpu_ns_[1]+=times.calc_light_grids;
+            gpu_ns_[2]+=times.calc_light_list;
+            gpu_ns_[3]+=times.calc_grid_offsets;
+        }
+        if (frame_ < WORKGROUP_TUNE_WARMUP_FRAMES + WORKGROUP_TUNE_FRAMES) return false;
+
+        const Workgroup_sizes &c=candidates_[round_];
+        float ms[4];
+        for (uint32_t i=0; i < 4; i++) ms[i]=static_cast<float>(gpu_ns_[i]) / (WORKGROUP_TUNE_FRAMES * 1000000.f);
+        const std::string offsets=std::to_string(c.calc_grid_offsets_x) + "x" + std::to_string(c.calc_grid_offsets_y);
+        printf("%7u  %8.3f  %6u  %8.3f  %6u  %8.3f  %7s  %8.3f\n", c.animate_lights, ms[0],
+               c.calc_light_grids, ms[1], c.calc_light_list, ms[2], offsets.c_str(), ms[3]);
+        if (ms[0] < best_ms_[0]) {
+            best_ms_[0]=ms[0];
+            best_.animate_lights=c.animate_lights;
+        }
+        if (ms[1] < best_ms_[1]) {
+            best_ms_[1]=ms[1];
+            best_.calc_light_grids=c.calc_light_grids;
+        }
+        if (ms[2] < best_ms_[2]) {
+            best_ms_[2]=ms[2];
+            best_.calc_light_list=c.calc_light_list;
+        }
+        if (ms[3] < best_ms_[3]) {
+            best_ms_[3]=ms[3];
+            best_.calc_grid_offsets_x=c.calc_grid_offsets_x;
+            best_.calc_grid_offsets_y=c.calc_grid_offsets_y;
+        }
+        if (++round_ < candidates_.size()) {
+            start_round_();
+            return true;
+        }
+
+        printf("fastest: animate lights %u, light grids %u, light list %u, grid offsets %ux%u, cached in %s\n",
+               best_.animate_lights, best_.calc_light_grids, best_.calc_light_list, best_.calc_grid_offsets_x, best_.calc_grid_offsets_y,
+               WORKGROUP_SIZES_CACHE);
+        fflush(stdout);
+        save_workgroup_sizes(WORKGROUP_SIZES_CACHE, device_name_, best_);
+        p_info_->workgroup_sizes=best_;
+        p_info_->num_lights=num_lights_;
+        p_info_->light_assignment=light_assignment_;
+        p_info_->grid_offsets_mode=grid_offsets_mode_;
+        p_info_->gpu_light_animation=gpu_light_animation_;
+        p_info_->gen_lights=true;
+        candidates_.clear();
+        p_info_->tune_workgroup_sizes=false;
+        return true;
+    }
+
+private:
+    static constexpr uint32_t WORKGROUP_TUNE_MIN_LIGHTS=16384;
+    static constexpr uint32_t WORKGROUP_TUNE_WARMUP_FRAMES=10;
+    static constexpr uint32_t WORKGROUP_TUNE_FRAMES=60;
+
+    Prog_info *p_info_;
+    vk::PhysicalDeviceLimits limits_;
+    std::string device_name_;
+    std::vector<Workgroup_sizes> candidates_; // empty before the first round
+    size_t round_{0};
+    uint32_t frame_{0};
+    uint64_t gpu_ns_[4]; // animate lights, light grids, light list, grid offsets
+    float best_ms_[4];
+    Workgroup_sizes best_;
+    // restored at the end
+    uint32_t num_lights_{0};
+    Light_assignment light_assignment_{LIGHT_ASSIGNMENT_LIST};
+    Grid_offsets_mode grid_offsets_mode_{GRID_OFFSETS_PREFIX_SUM};
+    bool gpu_light_animation_{false};
+
+    // the rounds within the device limits
+    void init_candidates_()
+    {
+        // animate lights, light grids, light list, grid offsets x, y
+        static const uint32_t candidates[][5]={
+            {32, 32, 32, 8, 8},
+            {64, 64, 64, 16, 8},
+            {128, 128, 128, 16, 16},
+            {256, 256, 256, 32, 8}
+        };
+        for (const auto &sizes : candidates) {
+            Workgroup_sizes c;
+            c.animate_lights=sizes[0];
+            c.calc_light_grids=sizes[1];
+            c.calc_light_list=sizes[2];
+            c.calc_grid_offsets_x=sizes[3];
+            c.calc_grid_offsets_y=sizes[4];
+            const uint32_t light_group_size=std::max({c.animate_lights, c.calc_light_grids, c.calc_light_list});
+            if (light_group_size > limits_.maxComputeWorkGroupSize[0] ||
+                light_group_size > limits_.maxComputeWorkGroupInvocations ||
+                c.calc_grid_offsets_x > limits_.maxComputeWorkGroupSize[0] ||
+                c.calc_grid_offsets_y > limits_.maxComputeWorkGroupSize[1] ||
+                c.calc_grid_offsets_x * c.calc_grid_offsets_y > limits_.maxComputeWorkGroupInvocations) continue;
+            candidates_.push_back(c);
+        }
+    }
+
+    void start_round_()
+    {
+        p_info_->workgroup_sizes=candidates_[round_];
+        frame_=0;
+        for (auto &ns : gpu_ns_) ns=0;
+    }
+};
@@ -1,6 +1,8 @@
 #version 450 core
-#define CAM_NEAR 0.1f
-#define GRID_DIM_Z 256
+#extension GL_GOOGLE_include_directive : require
+#include "../cluster/depth_keys.glsl"
+layout(constant_id = 1) const float CAM_NEAR = 0.1f;
+layout(constant_id = 0) const uint GRID_DIM_Z = 256;
 #define AMBIENT_GLOBAL 0.2f
 
 layout(set = 0, binding = 0) uniform readonly Material_properties {
@@ -35,15 +37,49 @@ layout(set = 2, binding = 0) uniform readonly UBO {
 
     vec2 resolution;
     uint num_lights;
+    float time;
+
+    vec4 light_pos_min; // packed lights bounds
+    vec4 light_pos_extent; // w: packed position error
 } ubo_in;
 
+#ifdef PACKED_LIGHTS
+// 16 bit unorm position inside the light bounds, half float range
+layout(set = 2, binding = 1, rg32ui) uniform readonly uimageBuffer light_pos_ranges;
+
+vec4 load_light_pos_range(int light_idx) {
+    uvec2 p = imageLoad(light_pos_ranges, light_idx).xy;
+    vec3 n = vec3(unpackUnorm2x16(p.x), unpackUnorm2x16(p.y).x);
+    return vec4(ubo_in.light_pos_min.xyz + n * ubo_in.light_pos_extent.xyz, unpackHalf2x16(p.y >> 16).x);
+}
+#else
 layout(set = 2, binding = 1, rgba32f) uniform readonly imageBuffer light_pos_ranges;
+
+vec4 load_light_pos_range(int light_idx) {
+    return imageLoad(light_pos_ranges, light_idx);
+}
+#endif
 layout(set = 2, binding = 2, rgba8) uniform readonly imageBuffer light_colors;
 
 layout(set = 3, binding = 0, r8ui) uniform readonly uimageBuffer grid_flags;
+#if defined(LIGHT_MASKS)
+layout(set = 3, binding = 13, r32ui) uniform readonly uimageBuffer light_masks;
+#elif defined(Z_BINS)
+layout(set = 3, binding = 14, r32ui) uniform readonly uimageBuffer light_depth_keys;
+layout(set = 3, binding = 15, r32ui) uniform readonly uimageBuffer z_bins;
+layout(set = 3, binding = 16, r32ui) uniform readonly uimageBuffer tile_light_masks;
+#elif defined(LINKED_LISTS)
+layout(set = 3, binding = 17, r32ui) uniform readonly uimageBuffer grid_light_heads;
+layout(set = 3, binding = 18, r32ui) uniform readonly uimageBuffer light_nodes;
+#else
 layout(set = 3, binding = 2, r32ui) uniform readonly uimageBuffer grid_light_counts;
 layout(set = 3, binding = 4, r32ui) uniform readonly uimageBuffer grid_light_count_offsets;
+#ifdef LIGHT_INDICES_16 // below 65536 lights
+layout(set = 3, binding = 5, r16ui) uniform readonly uimageBuffer light_list;
+#else
 layout(set = 3, binding = 5, r32ui) uniform readonly uimageBuffer light_list;
+#endif
+#endif
 
 layout (location= 0) in vec4 world_pos_in;
 layout (location= 1) in vec3 world_normal_in;
@@ -64,6 +100,29 @@ int grid_coord_to_grid_idx(uvec3 c) {
     return int(ubo_in.grid_dim.x * ubo_in.grid_dim.y * c.z + ubo_in.grid_dim.x * c.y + c.x);
 }
 
+vec3 shade_light(int light_idx, vec3 v, vec3 world_normal, vec3 mtl_c_diffuse, vec3 mtl_c_specular, vec3 fresnel_specular) {
+    vec4 light_pos_range = load_light_pos_range(light_idx);
+    float dist = distance(light_pos_range.xyz, world_pos_in.xyz);
+    if (dist >= light_pos_range.w) return vec3(0.f);
+
+    vec3 l = normalize(light_pos_range.xyz - world_pos_in.xyz);
+    vec3 h = normalize(0.5f * (v + l));
+
+    float lambertien = max(dot(world_normal, l), 0.f);
+    float atten = max(1.f - max(0.f, dist / light_pos_range.w), 0.f);
+
+    vec3 specular;
+    if (mtl_in.specular_exponent > 0.f) {
+	vec3 blinn_phong_specular = mtl_c_specular * pow(max(0.f, dot(h, world_normal)), mtl_in.specular_exponent);
+	specular = fresnel_specular + blinn_phong_specular;
+    } else {
+	specular = 0.5f * fresnel_specular;
+    }
+
+    vec3 light_color = imageLoad(light_colors, light_idx).rgb;
+    return light_color * lambertien * atten * (mtl_c_diffuse + specular);
+}
+
 void main()
 {
     vec3 mtl_c_diffuse = texture(mtl_diffuse_map, uv_in).rgb * mtl_in.diffuse;
@@ -91,32 +150,54 @@ void main()
 
     vec3 lighting = vec3(0.f);
     if (imageLoad(grid_flags, grid_idx).r == 1) {
+#if defined(LIGHT_MASKS)
+	// set bits in light index order
+	uint mask_words = (ubo_in.num_lights + 31) / 32;
+	int mask_base = grid_idx * int(mask_words);
+	for (uint w = 0; w < mask_words; w++) {
+	    uint mask = imageLoad(light_masks, mask_base + int(w)).r;
+	    while (mask != 0) {
+		int light_idx = int(w * 32 + findLSB(mask));
+		mask &= mask - 1;
+		lighting += shade_light(light_idx, v, world_normal, mtl_c_diffuse, mtl_c_specular, fresnel_specular);
+	    }
+	}
+#elif defined(Z_BINS)
+	// sorted slots in the slice's range whose bit the tile has set
+	uint bin_first = imageLoad(z_bins, int(2 * grid_coord.z)).r;
+	if (bin_first != 0) {
+	    uint first = ~bin_first;
+	    uint last = imageLoad(z_bins, int(2 * grid_coord.z + 1)).r - 1;
+	    uint mask_words = (ubo_in.num_lights + 31) / 32;
+	    int mask_base = int((ubo_in.grid_dim.x * grid_coord.y + grid_coord.x) * mask_words);
+	    for (uint w = first / 32; w <= last / 32; w++) {
+		uint mask = imageLoad(tile_light_masks, mask_base + int(w)).r;
+		if (w == first / 32) mask &= ~0u << (first % 32);
+		if (w == last / 32) mask &= ~0u >> (31 - last % 32);
+		while (mask != 0) {
+		    uint slot = w * 32 + findLSB(mask);
+		    mask &= mask - 1;
+		    int light_idx = int(imageLoad(light_depth_keys, int(slot)).r & DEPTH_KEY_LIGHT_IDX_MASK);
+		    lighting += shade_light(light_idx, v, world_normal, mtl_c_diffuse, mtl_c_specular, fresnel_specular);
+		}
+	    }
+	}
+#elif defined(LINKED_LISTS)
+	// node 0 ends the list
+	uint node = imageLoad(grid_light_heads, grid_idx).r;
+	while (node != 0) {
+	    int light_idx = int(imageLoad(light_nodes, int(2 * node)).r);
+	    node = imageLoad(light_nodes, int(2 * node + 1)).r;
+	    lighting += shade_light(light_idx, v, world_normal, mtl_c_diffuse, mtl_c_specular, fresnel_specular);
+	}
+#else
 	uint offset = imageLoad(grid_light_count_offsets, grid_idx).r;
 	uint light_count = imageLoad(grid_light_counts, grid_idx).r;
 	for (uint i = 0; i < light_count; i ++) {
-
 	    int light_idx = int(imageLoad(light_list, int(offset + i)).r);
-	    vec4 light_pos_range = imageLoad(light_pos_ranges, light_idx);
-	    float dist = distance(light_pos_range.xyz, world_pos_in.xyz);
-	    if (dist < light_pos_range.w) {
-		vec3 l = normalize(light_pos_range.xyz - world_pos_in.xyz);
-		vec3 h = normalize(0.5f * (v + l));
-
-		float lambertien = max(dot(world_normal, l), 0.f);
-		float atten = max(1.f - max(0.f, dist / light_pos_range.w), 0.f);
-
-		vec3 specular;
-		if (mtl_in.specular_exponent > 0.f) {
-		    vec3 blinn_phong_specular = mtl_c_specular * pow(max(0.f, dot(h, world_normal)), mtl_in.specular_exponent);
-		    specular = fresnel_specular + blinn_phong_specular;
-		} else {
-		    specular = 0.5f * fresnel_specular;
-		}
-
-		vec3 light_color = imageLoad(light_colors, light_idx).rgb;
-		lighting += light_color * lambertien * atten * (mtl_c_diffuse + specular);
-	    }
+	    lighting += shade_light(light_idx, v, world_normal, mtl_c_diffuse, mtl_c_specular, fresnel_specular);
 	}
+#endif
     }
     frag_color = vec4(lighting + ambient, mtl_in.alpha + (1.f - mtl_in.alpha) * fresnel);
 }
@@ -1,6 +1,8 @@
 #version 450 core
-#define CAM_NEAR 0.1f
-#define GRID_DIM_Z 256
+#extension GL_GOOGLE_include_directive : require
+#include "group_sizes.glsl"
+layout(constant_id = 1) const float CAM_NEAR = 0.1f;
+layout(constant_id = 0) const uint GRID_DIM_Z = 256;
 
 layout(early_fragment_tests) in;
 layout(location = 0) in vec4 world_pos_in;
@@ -20,9 +22,17 @@ layout(set = 0, binding = 0) uniform UBO
 
     vec2 resolution;
     uint num_lights;
+    float time;
+
+    vec4 light_pos_min; // packed lights bounds
+    vec4 light_pos_extent; // w: packed position error
 } ubo_in;
 
-layout(set = 1, binding = 0, r8ui) uniform uimageBuffer grid_flags;
+// r32ui view of the r8ui grid_flags, 4 flags per texel so that a flag can be
+// set atomically
+layout(set = 1, binding = 9, r32ui) uniform uimageBuffer grid_flag_words;
+layout(set = 1, binding = 10, r32ui) uniform uimageBuffer active_clusters;
+layout(set = 1, binding = 11, r32ui) uniform uimageBuffer active_cluster_dispatch; // groups x, y, z, active cluster count
 
 uvec3 view_pos_to_grid_coord(vec2 frag_pos, float view_z)
 {
@@ -41,5 +51,15 @@ void main ()
 {
     vec4 view_pos = ubo_in.view * world_pos_in;
     uint grid_idx = grid_coord_to_grid_idx(view_pos_to_grid_coord(gl_FragCoord.xy, view_pos.z));
-    imageStore(grid_flags, int(grid_idx), uvec4(1, 0, 0, 0));
+
+    // the first fragment of a cluster appends it to active_clusters, most
+    // fragments find their flag set already and skip the atomic
+    int word_idx = int(grid_idx >> 2);
+    uint flag = 1u << ((grid_idx & 3u) * 8u);
+    if ((imageLoad(grid_flag_words, word_idx).r & flag) == 0 &&
+	(imageAtomicOr(grid_flag_words, word_idx, flag) & flag) == 0) {
+	uint active_idx = imageAtomicAdd(active_cluster_dispatch, 3, 1);
+	imageStore(active_clusters, int(active_idx), uvec4(grid_idx, 0, 0, 0));
+	if (active_idx % ACTIVE_CLUSTER_GROUP_SIZE == 0) imageAtomicAdd(active_cluster_dispatch, 0, 1);
+    }
 }
@@ -17,6 +17,10 @@ layout(set = 0, binding = 0) uniform UBO
 
     vec2 resolution;
     uint num_lights;
+    float time;
+
+    vec4 light_pos_min; // packed lights bounds
+    vec4 light_pos_extent; // w: packed position error
 } ubo_in;
 
 out gl_PerVertex
@@ -0,0 +1,14 @@
+// fixed local sizes of the passes outside Workgroup_sizes, shared by the
+// shaders and Program.hpp, the defines also compile as c++. they stay fixed
+// where the code around them depends on them: clustering.frag counts the
+// indirect groups of the active cluster passes, calc_light_count_stats
+// reduces over a group in shared memory, the scan takes 4 entries per
+// invocation and the depth sort fills 16 KB of shared memory
+#ifndef ACTIVE_CLUSTER_GROUP_SIZE
+#define ACTIVE_CLUSTER_GROUP_SIZE 64
+#define LIGHT_CHUNK_CELLS 64 // of a light's bounds per chunk
+#define LIGHT_CHUNK_GROUP_SIZE 64
+#define SCAN_GROUP_SIZE 256
+#define SCAN_BLOCK_SIZE (SCAN_GROUP_SIZE * 4) // clusters or lights per scan group
+#define SORT_GROUP_SIZE 256
+#endif
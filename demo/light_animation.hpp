@@ -0,0 +1,225 @@
+#pragma once
+#include <simd.hpp>
+#include <cstdint>
+#include <cmath>
+
+// batched light animation kernels over the SoA light streams
+//
+// every light moves on a horizontal circle around the y axis through its
+// center; the position is a closed-form function of time
+//     angle = phase + angular_velocity * t
+//     position = center + (radius * cos(angle), elevation, -radius * sin(angle))
+// so any frame can be evaluated independently of the previous ones.
+//
+// all paths share the same range reduction and minimax polynomials (cephes
+// sinf/cosf) so that they agree up to fma rounding.
+
+struct Light_anim_args
+{
+    float time;
+    const float *center_x;
+    const float *center_y;
+    const float *center_z;
+    const float *radius;
+    const float *elevation;
+    const float *angular_velocity;
+    const float *phase;
+    const float *range;
+    float *pos_x;
+    float *pos_y;
+    float *pos_z;
+    float *p_pos_ranges; // vec4(position, range) per light
+};
+
+typedef void (*Animate_lights_fn)(const Light_anim_args &args, uint32_t begin, uint32_t end);
+
+// pi / 2 split in three parts for an accurate a - q * pi / 2
+#define LIGHT_ANIM_TWO_OVER_PI 0.636619772367581f
+#define LIGHT_ANIM_PIO2_1 1.5703125f
+#define LIGHT_ANIM_PIO2_2 4.837512969970703125e-4f
+#define LIGHT_ANIM_PIO2_3 7.54978995489188216e-8f
+#define LIGHT_ANIM_S1 -1.6666654611e-1f
+#define LIGHT_ANIM_S2 8.3321608736e-3f
+#define LIGHT_ANIM_S3 -1.9515295891e-4f
+#define LIGHT_ANIM_C1 4.166664568298827e-2f
+#define LIGHT_ANIM_C2 -1.388731625493765e-3f
+#define LIGHT_ANIM_C3 2.443315711809948e-5f
+
+void sincos_scalar(float a, float &s, float &c)
+{
+    float fq=nearbyintf(a * LIGHT_ANIM_TWO_OVER_PI);
+    int q=static_cast<int>(fq);
+    float r=((a - fq * LIGHT_ANIM_PIO2_1) - fq * LIGHT_ANIM_PIO2_2) - fq * LIGHT_ANIM_PIO2_3;
+    float r2=r * r;
+    float ps=r + r * r2 * (LIGHT_ANIM_S1 + r2 * (LIGHT_ANIM_S2 + r2 * LIGHT_ANIM_S3));
+    float pc=1.f - 0.5f * r2 + r2 * r2 * (LIGHT_ANIM_C1 + r2 * (LIGHT_ANIM_C2 + r2 * LIGHT_ANIM_C3));
+    s=(q & 1) ? pc : ps;
+    c=(q & 1) ? ps : pc;
+    if (q & 2) s=-s;
+    if ((q + 1) & 2) c=-c;
+}
+
+void animate_lights_scalar(const Light_anim_args &args, uint32_t begin, uint32_t end)
+{
+    for (uint32_t i=begin; i < end; i++) {
+        float s, c;
+        sincos_scalar(args.phase[i] + args.angular_velocity[i] * args.time, s, c);
+        float x=args.center_x[i] + args.radius[i] * c;
+        float y=args.center_y[i] + args.elevation[i];
+        float z=args.center_z[i] - args.radius[i] * s;
+        args.pos_x[i]=x;
+        args.pos_y[i]=y;
+        args.pos_z[i]=z;
+        args.p_pos_ranges[i * 4 + 0]=x;
+        args.p_pos_ranges[i * 4 + 1]=y;
+        args.p_pos_ranges[i * 4 + 2]=z;
+        args.p_pos_ranges[i * 4 + 3]=args.range[i];
+    }
+}
+
+BASE_TARGET_SSE41
+void sincos_sse41(__m128 a, __m128 &s, __m128 &c)
+{
+    const __m128i one=_mm_set1_epi32(1);
+    const __m128i two=_mm_set1_epi32(2);
+    __m128 fq=_mm_round_ps(_mm_mul_ps(a, _mm_set1_ps(LIGHT_ANIM_TWO_OVER_PI)),
+                           _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m128i q=_mm_cvtps_epi32(fq);
+    __m128 r=_mm_sub_ps(a, _mm_mul_ps(fq, _mm_set1_ps(LIGHT_ANIM_PIO2_1)));
+    r=_mm_sub_ps(r, _mm_mul_ps(fq, _mm_set1_ps(LIGHT_ANIM_PIO2_2)));
+    r=_mm_sub_ps(r, _mm_mul_ps(fq, _mm_set1_ps(LIGHT_ANIM_PIO2_3)));
+    __m128 r2=_mm_mul_ps(r, r);
+
+    __m128 ps=_mm_add_ps(_mm_set1_ps(LIGHT_ANIM_S2), _mm_mul_ps(r2, _mm_set1_ps(LIGHT_ANIM_S3)));
+    ps=_mm_add_ps(_mm_set1_ps(LIGHT_ANIM_S1), _mm_mul_ps(r2, ps));
+    ps=_mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), ps));
+
+    __m128 pc=_mm_add_ps(_mm_set1_ps(LIGHT_ANIM_C2), _mm_mul_ps(r2, _mm_set1_ps(LIGHT_ANIM_C3)));
+    pc=_mm_add_ps(_mm_set1_ps(LIGHT_ANIM_C1), _mm_mul_ps(r2, pc));
+    pc=_mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)),
+                  _mm_mul_ps(_mm_mul_ps(r2, r2), pc));
+
+    // odd quadrants swap sin and cos
+    __m128 swap=_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+    s=_mm_blendv_ps(ps, pc, swap);
+    c=_mm_blendv_ps(pc, ps, swap);
+    s=_mm_xor_ps(s, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30)));
+    c=_mm_xor_ps(c, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30)));
+}
+
+// begin must be a multiple of 4, the streams are 64-byte aligned
+BASE_TARGET_SSE41
+void animate_lights_sse41(const Light_anim_args &args, uint32_t begin, uint32_t end)
+{
+    const __m128 t=_mm_set1_ps(args.time);
+    uint32_t i=begin;
+    for (; i + 4 <= end; i+=4) {
+        __m128 a=_mm_add_ps(_mm_load_ps(args.phase + i), _mm_mul_ps(_mm_load_ps(args.angular_velocity + i), t));
+        __m128 s, c;
+        sincos_sse41(a, s, c);
+        __m128 radius=_mm_load_ps(args.radius + i);
+        __m128 x=_mm_add_ps(_mm_load_ps(args.center_x + i), _mm_mul_ps(radius, c));
+        __m128 y=_mm_add_ps(_mm_load_ps(args.center_y + i), _mm_load_ps(args.elevation + i));
+        __m128 z=_mm_sub_ps(_mm_load_ps(args.center_z + i), _mm_mul_ps(radius, s));
+        __m128 r=_mm_load_ps(args.range + i);
+        _mm_store_ps(args.pos_x + i, x);
+        _mm_store_ps(args.pos_y + i, y);
+        _mm_store_ps(args.pos_z + i, z);
+
+        // soa -> aos
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+        float *p_out=args.p_pos_ranges + i * 4;
+        _mm_storeu_ps(p_out + 0, x);
+        _mm_storeu_ps(p_out + 4, y);
+        _mm_storeu_ps(p_out + 8, z);
+        _mm_storeu_ps(p_out + 12, r);
+    }
+    animate_lights_scalar(args, i, end);
+}
+
+BASE_TARGET_AVX2
+void sincos_avx2(__m256 a, __m256 &s, __m256 &c)
+{
+    const __m256i one=_mm256_set1_epi32(1);
+    const __m256i two=_mm256_set1_epi32(2);
+    __m256 fq=_mm256_round_ps(_mm256_mul_ps(a, _mm256_set1_ps(LIGHT_ANIM_TWO_OVER_PI)),
+                              _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256i q=_mm256_cvtps_epi32(fq);
+    __m256 r=_mm256_fnmadd_ps(fq, _mm256_set1_ps(LIGHT_ANIM_PIO2_1), a);
+    r=_mm256_fnmadd_ps(fq, _mm256_set1_ps(LIGHT_ANIM_PIO2_2), r);
+    r=_mm256_fnmadd_ps(fq, _mm256_set1_ps(LIGHT_ANIM_PIO2_3), r);
+    __m256 r2=_mm256_mul_ps(r, r);
+
+    __m256 ps=_mm256_fmadd_ps(r2, _mm256_set1_ps(LIGHT_ANIM_S3), _mm256_set1_ps(LIGHT_ANIM_S2));
+    ps=_mm256_fmadd_ps(r2, ps, _mm256_set1_ps(LIGHT_ANIM_S1));
+    ps=_mm256_fmadd_ps(_mm256_mul_ps(r, r2), ps, r);
+
+    __m256 pc=_mm256_fmadd_ps(r2, _mm256_set1_ps(LIGHT_ANIM_C3), _mm256_set1_ps(LIGHT_ANIM_C2));
+    pc=_mm256_fmadd_ps(r2, pc, _mm256_set1_ps(LIGHT_ANIM_C1));
+    pc=_mm256_fmadd_ps(_mm256_mul_ps(r2, r2), pc,
+                       _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), r2, _mm256_set1_ps(1.f)));
+
+    // odd quadrants swap sin and cos
+    __m256 swap=_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+    s=_mm256_blendv_ps(ps, pc, swap);
+    c=_mm256_blendv_ps(pc, ps, swap);
+    s=_mm256_xor_ps(s, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30)));
+    c=_mm256_xor_ps(c, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30)));
+}
+
+// begin must be a multiple of 8, the streams are 64-byte aligned
+BASE_TARGET_AVX2
+void animate_lights_avx2(const Light_anim_args &args, uint32_t begin, uint32_t end)
+{
+    const __m256 t=_mm256_set1_ps(args.time);
+    uint32_t i=begin;
+    for (; i + 8 <= end; i+=8) {
+        __m256 a=_mm256_fmadd_ps(_mm256_load_ps(args.angular_velocity + i), t, _mm256_load_ps(args.phase + i));
+        __m256 s, c;
+        sincos_avx2(a, s, c);
+        __m256 radius=_mm256_load_ps(args.radius + i);
+        __m256 x=_mm256_fmadd_ps(radius, c, _mm256_load_ps(args.center_x + i));
+        __m256 y=_mm256_add_ps(_mm256_load_ps(args.center_y + i), _mm256_load_ps(args.elevation + i));
+        __m256 z=_mm256_fnmadd_ps(radius, s, _mm256_load_ps(args.center_z + i));
+        __m256 r=_mm256_load_ps(args.range + i);
+        _mm256_store_ps(args.pos_x + i, x);
+        _mm256_store_ps(args.pos_y + i, y);
+        _mm256_store_ps(args.pos_z + i, z);
+
+        // soa -> aos, lanes k and k + 4 end up in the same register
+        __m256 t0=_mm256_unpacklo_ps(x, y);
+        __m256 t1=_mm256_unpackhi_ps(x, y);
+        __m256 t2=_mm256_unpacklo_ps(z, r);
+        __m256 t3=_mm256_unpackhi_ps(z, r);
+        __m256 v0=_mm256_shuffle_ps(t0, t2, 0x44);
+        __m256 v1=_mm256_shuffle_ps(t0, t2, 0xee);
+        __m256 v2=_mm256_shuffle_ps(t1, t3, 0x44);
+        __m256 v3=_mm256_shuffle_ps(t1, t3, 0xee);
+        float *p_out=args.p_pos_ranges + i * 4;
+        _mm256_storeu_ps(p_out + 0, _mm256_permute2f128_ps(v0, v1, 0x20));
+        _mm256_storeu_ps(p_out + 8, _mm256_permute2f128_ps(v2, v3, 0x20));
+        _mm256_storeu_ps(p_out + 16, _mm256_permute2f128_ps(v0, v1, 0x31));
+        _mm256_storeu_ps(p_out + 24, _mm256_permute2f128_ps(v2, v3, 0x31));
+    }
+    animate_lights_scalar(args, i, end);
+}
+
+Animate_lights_fn select_animate_lights_fn(base::Simd_level level)
+{
+    switch (level) {
+        case base::SIMD_AVX2:return animate_lights_avx2;
+        case base::SIMD_SSE41:return animate_lights_sse41;
+        default:return animate_lights_scalar;
+    }
+}
+
+#undef LIGHT_ANIM_TWO_OVER_PI
+#undef LIGHT_ANIM_PIO2_1
+#undef LIGHT_ANIM_PIO2_2
+#undef LIGHT_ANIM_PIO2_3
+#undef LIGHT_ANIM_S1
+#undef LIGHT_ANIM_S2
+#undef LIGHT_ANIM_S3
+#undef LIGHT_ANIM_C1
+#undef LIGHT_ANIM_C2
+#undef LIGHT_ANIM_C3
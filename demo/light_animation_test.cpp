@@ -0,0 +1,155 @@
+#include "light_animation.hpp"
+#include <Aligned_array.hpp>
+#include <random.hpp>
+#include <simd.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// the simd kernels of light_animation.hpp against the scalar one and the
+// scalar one against double precision sin and cos, then lights/ms per level.
+// --lights n sets the light count, exits with 1 on a too large error
+
+// orbits of up to ORBIT_RADIUS * sqrt(2). the avx2 kernel rounds the angle
+// once with fma where the others round twice, that half ulp of the angle
+// times the radius comes on top of MAX_SIMD_POSITION_ERROR
+const float ORBIT_RADIUS=100.f;
+const float MAX_SIMD_POSITION_ERROR=1e-4f;
+const float MAX_SCALAR_POSITION_ERROR=1e-4f;
+const float ANIMATION_TIMES[]={0.f, 0.37f, 60.f, 3600.f}; // seconds
+const uint32_t BENCH_ROUNDS=20;
+
+struct Light_orbits
+{
+    base::Aligned_array<float> center_x, center_y, center_z, radius, elevation, angular_velocity, phase, range;
+    base::Aligned_array<float> pos_x, pos_y, pos_z, pos_ranges;
+
+    // the orbits of Program::generate_lights_ around a model of size ORBIT_RADIUS
+    explicit Light_orbits(uint32_t count)
+        :center_x(count), center_y(count), center_z(count), radius(count), elevation(count),
+        angular_velocity(count), phase(count), range(count),
+        pos_x(count), pos_y(count), pos_z(count), pos_ranges(static_cast<size_t>(count) * 4)
+    {
+        base::Random rng(0x4c49474854ull, 0);
+        for (uint32_t i=0; i < count; i++) {
+            const float x=rng.range(-ORBIT_RADIUS, ORBIT_RADIUS);
+            const float z=rng.range(-ORBIT_RADIUS, ORBIT_RADIUS);
+            center_x[i]=center_y[i]=center_z[i]=0.f;
+            radius[i]=sqrtf(x * x + z * z);
+            elevation[i]=rng.range(-ORBIT_RADIUS, ORBIT_RADIUS);
+            angular_velocity[i]=rng.range(0.03f, 0.09f);
+            phase[i]=atan2f(-z, x);
+            range[i]=rng.range(1.f, 4.5f);
+        }
+    }
+
+    Light_anim_args args(float time)
+    {
+        Light_anim_args a;
+        a.time=time;
+        a.center_x=center_x.data();
+        a.center_y=center_y.data();
+        a.center_z=center_z.data();
+        a.radius=radius.data();
+        a.elevation=elevation.data();
+        a.angular_velocity=angular_velocity.data();
+        a.phase=phase.data();
+        a.range=range.data();
+        a.pos_x=pos_x.data();
+        a.pos_y=pos_y.data();
+        a.pos_z=pos_z.data();
+        a.p_pos_ranges=pos_ranges.data();
+        return a;
+    }
+};
+
+// max difference of the positions and pos_ranges of two runs
+float max_position_error(const Light_orbits &a, const Light_orbits &b, uint32_t count)
+{
+    float error=0.f;
+    for (uint32_t i=0; i < count; i++) {
+        error=std::max(error, std::fabs(a.pos_x[i] - b.pos_x[i]));
+        error=std::max(error, std::fabs(a.pos_y[i] - b.pos_y[i]));
+        error=std::max(error, std::fabs(a.pos_z[i] - b.pos_z[i]));
+    }
+    for (size_t i=0; i < static_cast<size_t>(count) * 4; i++) {
+        error=std::max(error, std::fabs(a.pos_ranges[i] - b.pos_ranges[i]));
+    }
+    return error;
+}
+
+// position error of an angle error of one ulp
+float max_angle_rounding_error(const Light_orbits &orbits, float time, uint32_t count)
+{
+    float error=0.f;
+    for (uint32_t i=0; i < count; i++) {
+        const float a=orbits.phase[i] + orbits.angular_velocity[i] * time;
+        error=std::max(error, orbits.radius[i] * std::fabs(a) * FLT_EPSILON);
+    }
+    return error;
+}
+
+// same angle as the kernels, double precision sin and cos
+float max_reference_error(const Light_orbits &orbits, float time, uint32_t count)
+{
+    float error=0.f;
+    for (uint32_t i=0; i < count; i++) {
+        const float a=orbits.phase[i] + orbits.angular_velocity[i] * time;
+        const double x=orbits.center_x[i] + orbits.radius[i] * cos(a);
+        const double z=orbits.center_z[i] - orbits.radius[i] * sin(a);
+        error=std::max(error, static_cast<float>(std::fabs(orbits.pos_x[i] - x)));
+        error=std::max(error, static_cast<float>(std::fabs(orbits.pos_z[i] - z)));
+    }
+    return error;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t light_count=600001; // MAX_NUM_LIGHTS and a partial simd block
+    for (int i=1; i < argc; i++) {
+        if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) light_count=static_cast<uint32_t>(atoi(argv[++i]));
+    }
+
+    const base::Simd_level detected=base::detect_simd_level();
+    printf("lights: %u, cpu: %s\n", light_count, base::simd_level_str(detected));
+
+    Light_orbits ref(light_count), out(light_count);
+    bool ok=true;
+    for (float time : ANIMATION_TIMES) {
+        Light_anim_args ref_args=ref.args(time);
+        animate_lights_scalar(ref_args, 0, light_count);
+        const float ref_error=max_reference_error(ref, time, light_count);
+        printf("t %8.2f: scalar max error %g of %g\n", time, ref_error, MAX_SCALAR_POSITION_ERROR);
+        if (!(ref_error <= MAX_SCALAR_POSITION_ERROR)) ok=false;
+
+        const float max_error=MAX_SIMD_POSITION_ERROR + max_angle_rounding_error(ref, time, light_count);
+        for (int level=base::SIMD_SSE41; level <= detected; level++) {
+            Light_anim_args args=out.args(time);
+            select_animate_lights_fn(static_cast<base::Simd_level>(level))(args, 0, light_count);
+            const float error=max_position_error(ref, out, light_count);
+            printf("t %8.2f: %s max error %g of %g\n", time, base::simd_level_str(static_cast<base::Simd_level>(level)), error, max_error);
+            if (!(error <= max_error)) ok=false;
+        }
+    }
+
+    // best of the rounds, one thread
+    for (int level=base::SIMD_SCALAR; level <= detected; level++) {
+        const Animate_lights_fn fn=select_animate_lights_fn(static_cast<base::Simd_level>(level));
+        double best=1e30;
+        for (uint32_t round=0; round < BENCH_ROUNDS; round++) {
+            Light_anim_args args=out.args(0.016f * static_cast<float>(round));
+            auto start=std::chrono::steady_clock::now();
+            fn(args, 0, light_count);
+            std::chrono::duration<double, std::milli> ms=std::chrono::steady_clock::now() - start;
+            best=std::min(best, ms.count());
+        }
+        printf("%-7s %10.0f lights/ms\n", base::simd_level_str(static_cast<base::Simd_level>(level)), light_count / best);
+    }
+
+    printf(ok ? "passed\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
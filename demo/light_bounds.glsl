@@ -0,0 +1,14 @@
+// light_bounds, one rg32ui texel per light written by calc_light_grids.comp:
+// r the min and g the max grid coord, x in bits 0-9, y in 10-19 and z in
+// 20-31, room for 1024 x 1024 x 4096 clusters. lights that miss the grid
+// get min x 1 and max x 0, an empty x range, and zeros elsewhere
+
+uint pack_grid_coord(uvec3 coord)
+{
+    return coord.x | (coord.y << 10) | (coord.z << 20);
+}
+
+uvec3 unpack_grid_coord(uint bits)
+{
+    return uvec3(bits & 0x3ffu, (bits >> 10) & 0x3ffu, bits >> 20);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <simd.hpp>
+#include <cstdint>
+
+// sphere vs frustum culling over the SoA light streams
+//
+// a light is visible when its bounding sphere is not entirely on the outside
+// of any of the six planes
+//     dot(plane.xyz, position) + plane.w >= -range
+// the indices of visible lights are written to p_visible in increasing order
+// without branching on the test result: every candidate index is stored and
+// the output cursor only advances for the visible ones. p_visible needs room
+// for end - begin entries.
+
+struct Light_cull_args
+{
+    const float *pos_x;
+    const float *pos_y;
+    const float *pos_z;
+    const float *range;
+    float planes[6][4]; // (normal, d), normalized, positive inside
+};
+
+typedef uint32_t (*Cull_lights_fn)(const Light_cull_args &args, uint32_t begin, uint32_t end, uint32_t *p_visible);
+
+uint32_t cull_lights_scalar(const Light_cull_args &args, uint32_t begin, uint32_t end, uint32_t *p_visible)
+{
+    uint32_t n=0;
+    for (uint32_t i=begin; i < end; i++) {
+        const float x=args.pos_x[i], y=args.pos_y[i], z=args.pos_z[i], r=-args.range[i];
+        uint32_t inside=1;
+        for (int p=0; p < 6; p++) {
+            const float *pl=args.planes[p];
+            inside&=static_cast<uint32_t>(pl[0] * x + pl[1] * y + pl[2] * z + pl[3] >= r);
+        }
+        p_visible[n]=i;
+        n+=inside;
+    }
+    return n;
+}
+
+// begin must be a multiple of 4, the streams are 64-byte aligned
+BASE_TARGET_SSE41
+uint32_t cull_lights_sse41(const Light_cull_args &args, uint32_t begin, uint32_t end, uint32_t *p_visible)
+{
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (int p=0; p < 6; p++) {
+        px[p]=_mm_set1_ps(args.planes[p][0]);
+        py[p]=_mm_set1_ps(args.planes[p][1]);
+        pz[p]=_mm_set1_ps(args.planes[p][2]);
+        pw[p]=_mm_set1_ps(args.planes[p][3]);
+    }
+    const __m128 sign=_mm_set1_ps(-0.f);
+    uint32_t n=0;
+    uint32_t i=begin;
+    for (; i + 4 <= end; i+=4) {
+        const __m128 x=_mm_load_ps(args.pos_x + i);
+        const __m128 y=_mm_load_ps(args.pos_y + i);
+        const __m128 z=_mm_load_ps(args.pos_z + i);
+        const __m128 r=_mm_xor_ps(_mm_load_ps(args.range + i), sign);
+        __m128 inside=_mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p=0; p < 6; p++) {
+            __m128 d=_mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                                _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+            inside=_mm_and_ps(inside, _mm_cmpge_ps(d, r));
+        }
+        const uint32_t mask=static_cast<uint32_t>(_mm_movemask_ps(inside));
+        for (uint32_t k=0; k < 4; k++) {
+            p_visible[n]=i + k;
+            n+=(mask >> k) & 1;
+        }
+    }
+    return n + cull_lights_scalar(args, i, end, p_visible + n);
+}
+
+// begin must be a multiple of 8, the streams are 64-byte aligned
+BASE_TARGET_AVX2
+uint32_t cull_lights_avx2(const Light_cull_args &args, uint32_t begin, uint32_t end, uint32_t *p_visible)
+{
+    __m256 px[6], py[6], pz[6], pw[6];
+    for (int p=0; p < 6; p++) {
+        px[p]=_mm256_set1_ps(args.planes[p][0]);
+        py[p]=_mm256_set1_ps(args.planes[p][1]);
+        pz[p]=_mm256_set1_ps(args.planes[p][2]);
+        pw[p]=_mm256_set1_ps(args.planes[p][3]);
+    }
+    const __m256 sign=_mm256_set1_ps(-0.f);
+    uint32_t n=0;
+    uint32_t i=begin;
+    for (; i + 8 <= end; i+=8) {
+        const __m256 x=_mm256_load_ps(args.pos_x + i);
+        const __m256 y=_mm256_load_ps(args.pos_y + i);
+        const __m256 z=_mm256_load_ps(args.pos_z + i);
+        const __m256 r=_mm256_xor_ps(_mm256_load_ps(args.range + i), sign);
+        __m256 inside=_mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p=0; p < 6; p++) {
+            __m256 d=_mm256_fmadd_ps(px[p], x, _mm256_fmadd_ps(py[p], y, _mm256_fmadd_ps(pz[p], z, pw[p])));
+            inside=_mm256_and_ps(inside, _mm256_cmp_ps(d, r, _CMP_GE_OQ));
+        }
+        const uint32_t mask=static_cast<uint32_t>(_mm256_movemask_ps(inside));
+        for (uint32_t k=0; k < 8; k++) {
+            p_visible[n]=i + k;
+            n+=(mask >> k) & 1;
+        }
+    }
+    return n + cull_lights_scalar(args, i, end, p_visible + n);
+}
+
+Cull_lights_fn select_cull_lights_fn(base::Simd_level level)
+{
+    switch (level) {
+        case base::SIMD_AVX2:return cull_lights_avx2;
+        case base::SIMD_SSE41:return cull_lights_sse41;
+        default:return cull_lights_scalar;
+    }
+}
@@ -18,6 +18,10 @@ layout(set = 0, binding = 0) uniform UBO
 
     vec2 resolution;
     uint num_lights;
+    float time;
+
+    vec4 light_pos_min; // packed lights bounds
+    vec4 light_pos_extent; // w: packed position error
 } ubo_in;
 
 out gl_PerVertex
@@ -31,6 +35,12 @@ layout (location = 0) out vec3 color_out;
 void main()
 {
     color_out = color_in.xyz;
-    gl_Position = ubo_in.projection_clip * ubo_in.view * vec4(pos_range_in.xyz, 1.f);
+#ifdef PACKED_LIGHTS
+    // fetched as rgba16 unorm, w holds the range bits
+    vec3 pos = ubo_in.light_pos_min.xyz + pos_range_in.xyz * ubo_in.light_pos_extent.xyz;
+#else
+    vec3 pos = pos_range_in.xyz;
+#endif
+    gl_Position = ubo_in.projection_clip * ubo_in.view * vec4(pos, 1.f);
     gl_PointSize =  0.2f * ubo_in.cam_far / gl_Position.z;
 }
@@ -2,11 +2,20 @@
 #include "Prog_info.hpp"
 #include "Shell.hpp"
 #include "Program.hpp"
+#include <cstring>
 
-int main()
+int main(int argc, char **argv)
 {
     {
         Prog_info prog_info{};
+        for (int i=1; i < argc; i++) {
+            if (strcmp(argv[i], "--packed-lights") == 0) prog_info.packed_lights=true;
+            if (strcmp(argv[i], "--benchmark") == 0) prog_info.benchmark=true;
+            if (strcmp(argv[i], "--autotune") == 0) prog_info.start_autotune();
+            if (strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc) prog_info.camera_path_file=argv[++i];
+            if (strcmp(argv[i], "--tune-workgroup-sizes") == 0) prog_info.tune_workgroup_sizes=true;
+            if (strcmp(argv[i], "--r32-light-indices") == 0) prog_info.compact_light_indices=false;
+        }
         base::Camera camera{};
         Shell shell{&prog_info, &camera};
         Program program{&prog_info, &shell, false, &camera};